@@ -0,0 +1,148 @@
+#include "USBBenchmark.h"
+
+#ifdef USB_BENCHMARK
+
+/* Names of the standard requests, indexed by bRequest */
+static const char *requestNames[STANDARD_REQUESTS] = {
+    "GET_STATUS", "CLEAR_FEATURE", "reserved_2", "SET_FEATURE",
+    "reserved_4", "SET_ADDRESS", "GET_DESCRIPTOR", "SET_DESCRIPTOR",
+    "GET_CONFIGURATION", "SET_CONFIGURATION", "GET_INTERFACE", "SET_INTERFACE"
+};
+
+USBBenchmark::USBBenchmark() {
+    cycleCounterEnable();
+}
+
+void USBBenchmark::printCycles(FILE *output, const char *name, CYCLE_STATISTICS *statistics) {
+    unsigned long average = 0;
+    unsigned long min = 0;
+    
+    if (statistics->count > 0) {
+        average = statistics->total / statistics->count;
+        min = statistics->min;
+    }
+    fprintf(output, "    \"%s\": {\"count\": %lu, \"min\": %lu, \"avg\": %lu, \"max\": %lu},\n",
+        name, statistics->count, min, average, statistics->max);
+}
+
+void USBBenchmark::benchmarkEndpointWrite(FILE *output, const char *name, unsigned char id, unsigned char size, int iterations) {
+    /* Time the endpoint write of an input report of size bytes, including */
+    /* the report ID. The report is sent the usual way, owning the endpoint, */
+    /* and the host sees an all zero report. */
+    int i;
+    
+    cycleStatisticsReset(&writeCycles);
+    for (i = 0; i < iterations; i++) {
+        sendInputReport(id, NULL, size - 1);
+    }
+    printCycles(output, name, &writeCycles);
+}
+
+/* Lower case text typed by the typing benchmark */
+static char typingText[] = "the quick brown fox jumps over the lazy dog ";
+
+void USBBenchmark::benchmarkTyping(FILE *output, const char *name, bool nkro, int iterations) {
+    /* Characters per second typed with 6-key or N-key rollover reports, */
+    /* including the wait for the host to poll the interrupt endpoint */
+    Timer timer;
+    unsigned long characters = 0;
+    unsigned long reports;
+    unsigned long elapsed;
+    int i;
+    
+    setNKRO(nkro);
+    reports = getInputReportCount();
+    timer.start();
+    for (i = 0; i < iterations; i++) {
+        keyboard(typingText);
+        characters += sizeof(typingText) - 1;
+    }
+    timer.stop();
+    elapsed = timer.read_us();
+    reports = getInputReportCount() - reports;
+    setNKRO(false);
+    
+    fprintf(output, "    \"%s\": {\"chars_per_second\": %lu, \"reports_per_100_chars\": %lu},\n", name,
+        (elapsed > 0) ? (unsigned long)((unsigned long long)characters * 1000000 / elapsed) : 0,
+        (characters > 0) ? reports * 100 / characters : 0);
+}
+
+void USBBenchmark::run(FILE *output, int iterations) {
+    ENUMERATION_STATISTICS enumeration;
+    SIE_STATISTICS sie;
+    unsigned long reports;
+    unsigned long average;
+    unsigned long divisor;
+    int i;
+    
+    fprintf(output, "{\n  \"iterations\": %d,\n  \"cycles\": {\n", iterations);
+    
+    /* One mouse report */
+    cycleStatisticsReset(&submitCycles);
+    resetSIEStatistics();
+    for (i = 0; i < iterations; i++) {
+        mouse(0, 0);
+    }
+    printCycles(output, "mouse", &submitCycles);
+    getSIEStatistics(&sie);
+    
+    /* One key press and release */
+    cycleStatisticsReset(&submitCycles);
+    for (i = 0; i < iterations; i++) {
+        keyboard(' ');
+    }
+    printCycles(output, "keyboard_report", &submitCycles);
+    
+    /* Raw endpoint writes */
+    benchmarkEndpointWrite(output, "endpointWrite_5", REPORT_ID_MOUSE, 5, iterations);
+    benchmarkEndpointWrite(output, "endpointWrite_9", REPORT_ID_KEYBOARD, 9, iterations);
+    benchmarkEndpointWrite(output, "endpointWrite_nkro", REPORT_ID_NKRO, NKRO_REPORT_SIZE + 1, iterations);
+    
+    /* A large movement split into many reports */
+    cycleStatisticsReset(&submitCycles);
+    reports = getInputReportCount();
+    move(1000, -1000);
+    move(-1000, 1000);
+    reports = getInputReportCount() - reports;
+    printCycles(output, "move_large_report", &submitCycles);
+    
+    /* Interrupt dispatch, including the events caused above */
+    printCycles(output, "isr", &profileStages[PROFILE_ISR]);
+    fprintf(output, "    \"move_large_reports\": %lu\n  },\n", reports);
+    
+    /* SIE transactions per mouse report */
+    if (iterations <= 0) {
+        sie.commands = 0;
+        sie.writes = 0;
+        sie.reads = 0;
+    }
+    divisor = (iterations > 0) ? iterations : 1;
+    fprintf(output, "  \"sie_per_mouse_report\": {\"commands\": %lu, \"writes\": %lu, \"reads\": %lu},\n",
+        sie.commands / divisor, sie.writes / divisor, sie.reads / divisor);
+    
+    /* Typing throughput */
+    fprintf(output, "  \"typing\": {\n");
+    benchmarkTyping(output, "6kro", false, iterations);
+    benchmarkTyping(output, "nkro", true, iterations);
+    fprintf(output, "    \"text_length\": %u\n  },\n", (unsigned int)(sizeof(typingText) - 1));
+    
+    /* Control requests handled during enumeration, in microseconds */
+    getEnumerationStatistics(&enumeration);
+    fprintf(output, "  \"reset_to_configured_us\": %lu,\n  \"control_setup_us\": {\n", enumeration.resetToConfigured);
+    for (i = 0; i < STANDARD_REQUESTS; i++) {
+        average = 0;
+        if (enumeration.standard[i].count > 0) {
+            average = enumeration.standard[i].totalTime / enumeration.standard[i].count;
+        }
+        fprintf(output, "    \"%s\": {\"count\": %lu, \"avg\": %lu, \"max\": %lu},\n", requestNames[i],
+            enumeration.standard[i].count, average, enumeration.standard[i].maxTime);
+    }
+    average = 0;
+    if (enumeration.other.count > 0) {
+        average = enumeration.other.totalTime / enumeration.other.count;
+    }
+    fprintf(output, "    \"class_and_vendor\": {\"count\": %lu, \"avg\": %lu, \"max\": %lu}\n  }\n}\n",
+        enumeration.other.count, average, enumeration.other.maxTime);
+}
+
+#endif
@@ -0,0 +1,50 @@
+#include "USBMouse.h"
+#include "usbcycles.h"
+
+#ifndef MBED_USBBENCHMARK_H
+#define MBED_USBBENCHMARK_H
+
+/* Class: USBBenchmark
+ * Measure the CPU cost of the report and control paths of the USB
+ * stack and print the results as JSON. Build with USB_BENCHMARK defined;
+ * the device must be connected to a host that enumerates it.
+ *
+ * Cycles are counted with the Cortex-M3 DWT cycle counter and exclude
+ * time spent waiting for the host to poll the interrupt endpoint.
+ * Control request times are those measured while the host enumerated
+ * the device, in microseconds.
+ *
+ * Example:
+ * > #include "mbed.h"
+ * > #include "USBBenchmark.h"
+ * > 
+ * > USBBenchmark benchmark;
+ * >
+ * > int main() {
+ * >     wait(5);
+ * >     benchmark.run(stdout, 100);
+ * > }
+ */
+class USBBenchmark : public USBMouse {
+public:
+    /* Constructor: USBBenchmark
+     * Create a USB Mouse and start the cycle counter
+     */
+    USBBenchmark();
+    
+    /* Function: run
+     * Run every benchmark and print the results
+     *
+     * Variables:
+     *  output - Where the JSON results are written
+     *  iterations - Number of times each measured operation is repeated
+     */
+    void run(FILE *output, int iterations);
+    
+private:
+    void printCycles(FILE *output, const char *name, CYCLE_STATISTICS *statistics);
+    void benchmarkEndpointWrite(FILE *output, const char *name, unsigned char id, unsigned char size, int iterations);
+    void benchmarkTyping(FILE *output, const char *name, bool nkro, int iterations);
+};
+
+#endif
@@ -1,7 +1,12 @@
+#include <limits.h>
 #include "USBMouse.h"
 
 USBMouse::USBMouse() {
     _buttons = 0;
+    _remainderX = 0;
+    _remainderY = 0;
+    _curve = NULL;
+    _curveSize = 0;
 }
 
 void USBMouse::move(int x, int y) {
@@ -24,6 +29,80 @@ void USBMouse::move(int x, int y) {
     mouse(x, y, _buttons, 0);
 }
 
+bool USBMouse::move(long x, long y, int fractionBits) {
+    long long dx, dy, speed, totalX, totalY, wholeX, wholeY, stepX, stepY;
+    
+    if((fractionBits < 0) || (fractionBits > MOUSE_FRACTION_BITS)) {
+        return false;
+    }
+    
+    /* Bring to MOUSE_FRACTION_BITS; nothing below the caller's precision */
+    /* is lost */
+    dx = (long long)x * (1L << (MOUSE_FRACTION_BITS - fractionBits));
+    dy = (long long)y * (1L << (MOUSE_FRACTION_BITS - fractionBits));
+    
+    if(_curve != NULL) {
+        speed = (dx < 0) ? -dx : dx;
+        speed = ((dy < 0) ? -dy : dy) > speed ? ((dy < 0) ? -dy : dy) : speed;
+        dx = accelerate(dx, speed);
+        dy = accelerate(dy, speed);
+    }
+    
+    /* Send the whole counts and carry the rest; division truncates towards */
+    /* zero, so the remainder keeps the sign of the total */
+    totalX = _remainderX + dx;
+    totalY = _remainderY + dy;
+    wholeX = totalX / MOUSE_UNITY;
+    wholeY = totalY / MOUSE_UNITY;
+    _remainderX = (long)(totalX - wholeX * MOUSE_UNITY);
+    _remainderY = (long)(totalY - wholeY * MOUSE_UNITY);
+    
+    /* An accelerated move may not fit an int */
+    while((wholeX != 0) || (wholeY != 0)) {
+        stepX = (wholeX > INT_MAX) ? INT_MAX : ((wholeX < -INT_MAX) ? -INT_MAX : wholeX);
+        stepY = (wholeY > INT_MAX) ? INT_MAX : ((wholeY < -INT_MAX) ? -INT_MAX : wholeY);
+        move((int)stepX, (int)stepY);
+        wholeX -= stepX;
+        wholeY -= stepY;
+    }
+    return true;
+}
+
+void USBMouse::setAcceleration(const unsigned short *curve, int size) {
+    _curve = (size > 0) ? curve : NULL;
+    _curveSize = size;
+}
+
+long long USBMouse::accelerate(long long value, long long speed) {
+    /* Scale by the curve's gain at speed (1/MOUSE_UNITY counts per move), */
+    /* interpolating between entries */
+    long long index = speed / MOUSE_UNITY;
+    long long fraction = speed % MOUSE_UNITY;
+    long long gain;
+    
+    if(index >= _curveSize - 1) {
+        gain = _curve[_curveSize - 1];
+    } else {
+        gain = _curve[index] + (((long long)_curve[index + 1] - _curve[index]) * fraction) / MOUSE_UNITY;
+    }
+    return (value * gain) / MOUSE_GAIN_UNITY;
+}
+
+bool USBMouse::moveAsync(int x, int y, INPUT_CALLBACK callback, void *context) {
+    int dx, dy;
+    
+    while((x > 127) || (x < -128) || (y > 127) || (y < -128)) {
+        dx = (x > 127) ? 127 : ((x < -128) ? -128 : x);
+        dy = (y > 127) ? 127 : ((y < -128) ? -128 : y);
+        if(!postMouse(dx, dy, _buttons, 0)) {
+            return false;
+        }
+        x = x - dx;
+        y = y - dy;
+    }
+    return postMouse(x, y, _buttons, 0, callback, context);
+}
+
 void USBMouse::scroll(int z) {
     while(z > 127) {
         mouse(0, 0, _buttons, 127);
@@ -37,7 +116,7 @@ void USBMouse::scroll(int z) {
 }
 
 void USBMouse::buttons(int left, int middle, int right) {
-    int _buttons = 0;
+    _buttons = 0;
     if(left) {
         _buttons |= MOUSE_L;
     }
@@ -49,3 +128,7 @@ void USBMouse::buttons(int left, int middle, int right) {
     }
     mouse(0,0, _buttons, 0);    
 }    
+
+int USBMouse::poll() {
+    return usbhid::poll();
+}
@@ -3,6 +3,14 @@
 #ifndef MBED_USBMOUSE_H
 #define MBED_USBMOUSE_H
 
+/* Fraction bits of the motion carried between fixed point moves; the */
+/* most a move may be given */
+#define MOUSE_FRACTION_BITS (16)
+#define MOUSE_UNITY         (1L << MOUSE_FRACTION_BITS)
+
+/* Acceleration curve gain of 1 */
+#define MOUSE_GAIN_UNITY    (256)
+
 /* Class: USBMouse
  * Emulate a USB Mouse HID device
  *
@@ -19,7 +27,7 @@
  * >     }
  * > }
  */
-class USBMouse : private usbhid {
+class USBMouse : protected usbhid {
 public:
     /* Constructor: USBMouse
      * Create a USB Mouse using the mbed USB Device interface
@@ -35,6 +43,48 @@ public:
      */
     void move(int x, int y);
     
+    /* Function: move
+     * Move the mouse by a fixed point distance, such as a sensor reading.
+     * The fraction left over is carried into the next move, so nothing is
+     * lost to rounding and no report is sent until a whole count has built
+     * up. The acceleration curve, if set, is applied first.
+     *
+     * Variables:
+     *  x - Distance to move in x-axis, in 1/(2^fractionBits) counts
+     *  y - Distance to move in y-axis, in 1/(2^fractionBits) counts
+     *  fractionBits - Fraction bits of x and y, 0 to MOUSE_FRACTION_BITS
+     *  returns - false if fractionBits is out of range; nothing is moved
+     */
+    bool move(long x, long y, int fractionBits);
+    
+    /* Function: setAcceleration
+     * Set the acceleration curve used by fixed point moves. Entry n is
+     * the gain, in 1/MOUSE_GAIN_UNITY, at a speed of n counts per move; gains
+     * between entries are interpolated and the last entry holds for any
+     * faster speed. Integer only.
+     *
+     * Example:
+     * > static const unsigned short curve[] = {256, 256, 320, 448, 640};
+     * > mouse.setAcceleration(curve, 5);
+     *
+     * Variables:
+     *  curve - The gains, left unchanged while in use; NULL for none
+     *  size - Number of entries
+     */
+    void setAcceleration(const unsigned short *curve, int size);
+    
+    /* Function: moveAsync
+     * Move the mouse without waiting for the host
+     *
+     * Variables:
+     *  x - Distance to move in x-axis 
+     *  y - Distance to move in y-axis
+     *  callback - Called from the USB interrupt once the move has been sent (optional)
+     *  context - Passed to callback
+     *  returns - false if the input queue is full; callback is then not called
+     */
+    bool moveAsync(int x, int y, INPUT_CALLBACK callback=NULL, void *context=NULL);
+    
     /* Function: scroll
      * Scroll the scroll wheel
      *
@@ -53,8 +103,22 @@ public:
      */
     void buttons(int left, int middle, int right);    
     
+    /* Function: poll
+     * Process pending USB events when built with USB_POLLED, where
+     * the USB interrupt is never enabled
+     *
+     * Variables:
+     *  returns - The number of events processed
+     */
+    int poll();
+    
 private:
+    long long accelerate(long long value, long long speed);
     int _buttons;
+    long _remainderX;                /* Motion not yet sent, in 1/MOUSE_UNITY counts */
+    long _remainderY;
+    const unsigned short *_curve;
+    int _curveSize;
 };
 
 #endif
@@ -0,0 +1,82 @@
+#include <limits.h>
+#include "USBPointer.h"
+
+USBPointer::USBPointer(usbhid &device, int index) {
+    _device = &device;
+    _index = index;
+    _buttons = 0;
+    _x = 0;
+    _y = 0;
+    _z = 0;
+}
+
+bool USBPointer::move(int x, int y, INPUT_CALLBACK callback, void *context) {
+    int dx, dy;
+    bool last;
+    
+    if(!carry(_x, x) || !carry(_y, y)) {
+        return false;
+    }
+    _x = _x + x;
+    _y = _y + y;
+    do {
+        dx = (_x > 127) ? 127 : ((_x < -128) ? -128 : _x);
+        dy = (_y > 127) ? 127 : ((_y < -128) ? -128 : _y);
+        last = (dx == _x) && (dy == _y);
+        if(!_device->postPointer(_index, dx, dy, _buttons, 0,
+                                 last ? callback : NULL, last ? context : NULL)) {
+            /* The rest is carried to the next move */
+            return true;
+        }
+        _x = _x - dx;
+        _y = _y - dy;
+    } while(!last);
+    return true;
+}
+
+bool USBPointer::scroll(int z) {
+    int dz;
+    bool last;
+    
+    if(!carry(_z, z)) {
+        return false;
+    }
+    _z = _z + z;
+    do {
+        dz = (_z > 127) ? 127 : ((_z < -128) ? -128 : _z);
+        last = (dz == _z);
+        if(!_device->postPointer(_index, 0, 0, _buttons, dz)) {
+            return true;
+        }
+        _z = _z - dz;
+    } while(!last);
+    return true;
+}
+
+bool USBPointer::buttons(int left, int middle, int right) {
+    /* Motion carried from before goes with the old buttons */
+    move(0, 0);
+    scroll(0);
+    if((_x != 0) || (_y != 0) || (_z != 0)) {
+        return false;
+    }
+    _buttons = 0;
+    if(left) {
+        _buttons |= MOUSE_L;
+    }
+    if(middle) {
+        _buttons |= MOUSE_M;
+    }
+    if(right) {
+        _buttons |= MOUSE_R;
+    }
+    return _device->postPointer(_index, 0, 0, _buttons, 0);
+}
+
+bool USBPointer::carry(int total, int delta) {
+    /* True if delta can be added to the carried total without overflow */
+    if(delta > 0) {
+        return total <= INT_MAX - delta;
+    }
+    return total >= INT_MIN - delta;
+}
@@ -0,0 +1,85 @@
+#include "usbhid.h"
+
+#ifndef MBED_USBPOINTER_H
+#define MBED_USBPOINTER_H
+
+/* Class: USBPointer
+ * One of several independent mice on a single usbhid device. Build
+ * with POINTERS set to the number needed; each is a separate top level
+ * collection, so the host can give each its own cursor or read each
+ * device separately. Reports are queued and never wait for the host.
+ *
+ * Example:
+ * > #include "mbed.h"
+ * > #include "USBPointer.h"
+ * > 
+ * > usbhid device;
+ * > USBPointer first(device, 0);
+ * > USBPointer second(device, 1);
+ * >
+ * > int main() {
+ * >     while(1) {
+ * >         first.move(10, 0);
+ * >         second.move(0, 10);
+ * >         wait(2);
+ * >     }
+ * > }
+ */
+class USBPointer {
+public:
+    /* Constructor: USBPointer
+     * Use one of the pointers of a usbhid device
+     *
+     * Variables:
+     *  device - The device carrying the pointer
+     *  index - 0 to POINTERS-1; 0 shares the device's mouse
+     */
+    USBPointer(usbhid &device, int index);
+    
+    /* Function: move
+     * Move the pointer. A move too large for one report is split; whatever
+     * doesn't fit in the input queue is carried and sent with the next move.
+     *
+     * Variables:
+     *  x - Distance to move in x-axis 
+     *  y - Distance to move in y-axis
+     *  callback - Called from the USB interrupt once the move has been sent (optional)
+     *  context - Passed to callback
+     *  returns - true if the move was queued or carried; false only if the
+     *            carried motion would overflow, when none of it is taken.
+     *            callback is called only if the whole move was queued.
+     */
+    bool move(int x, int y, INPUT_CALLBACK callback=NULL, void *context=NULL);
+    
+    /* Function: scroll
+     * Scroll the scroll wheel; carried like move when the queue is full
+     *
+     * Variables:
+     *  z - Distance to scroll scroll wheel
+     *  returns - as move
+     */
+    bool scroll(int z);
+    
+    /* Function: buttons
+     * Set the state of the buttons
+     *
+     * Variables:
+     *  left - set the left button as down (1) or up (0)
+     *  middle - set the middle button as down (1) or up (0)
+     *  right - set the right button as down (1) or up (0)
+     *  returns - false if the input queue is full, or carried motion
+     *            could not be queued first
+     */
+    bool buttons(int left, int middle, int right);
+    
+private:
+    static bool carry(int total, int delta);
+    usbhid *_device;
+    unsigned char _index;
+    unsigned char _buttons;
+    int _x;                 /* Motion not yet queued */
+    int _y;
+    int _z;
+};
+
+#endif
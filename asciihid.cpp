@@ -0,0 +1,265 @@
+/* asciihid.cpp */
+/* Keyboard layout registry and character lookup */
+
+/* The ASCII range of each layout is a direct-index table (keymaps.h). */
+/* Other characters, and ASCII characters that need a dead key, are    */
+/* found by binary search in a short table sorted by code point.       */
+
+#include "mbed.h"
+#include "asciihid.h"
+#include "keymaps.h"
+
+/* UK keyboard, characters beyond the ASCII table */
+static const KEYMAP_EXTENDED extendedUK[] = {
+{0x00a3, {0, 0}, {0x20, SHIFT}},            /* pound sign */
+{0x00a6, {0, 0}, {0x35, ALTGR}},            /* broken bar */
+{0x00ac, {0, 0}, {0x35, SHIFT}},            /* not sign */
+{0x00c1, {0, 0}, {0x04, SHIFT|ALTGR}},      /* latin capital letter a with acute */
+{0x00c9, {0, 0}, {0x08, SHIFT|ALTGR}},      /* latin capital letter e with acute */
+{0x00cd, {0, 0}, {0x0c, SHIFT|ALTGR}},      /* latin capital letter i with acute */
+{0x00d3, {0, 0}, {0x12, SHIFT|ALTGR}},      /* latin capital letter o with acute */
+{0x00da, {0, 0}, {0x18, SHIFT|ALTGR}},      /* latin capital letter u with acute */
+{0x00e1, {0, 0}, {0x04, ALTGR}},            /* latin small letter a with acute */
+{0x00e9, {0, 0}, {0x08, ALTGR}},            /* latin small letter e with acute */
+{0x00ed, {0, 0}, {0x0c, ALTGR}},            /* latin small letter i with acute */
+{0x00f3, {0, 0}, {0x12, ALTGR}},            /* latin small letter o with acute */
+{0x00fa, {0, 0}, {0x18, ALTGR}},            /* latin small letter u with acute */
+{0x20ac, {0, 0}, {0x21, ALTGR}},            /* euro sign */
+};
+
+/* German keyboard, characters beyond the ASCII table */
+static const KEYMAP_EXTENDED extendedDE[] = {
+{0x005e, {0x35, 0}, {0x2c, 0}},             /* ^ */
+{0x0060, {0x2e, SHIFT}, {0x2c, 0}},         /* ` */
+{0x00a7, {0, 0}, {0x20, SHIFT}},            /* section sign */
+{0x00b0, {0, 0}, {0x35, SHIFT}},            /* degree sign */
+{0x00b2, {0, 0}, {0x1f, ALTGR}},            /* superscript two */
+{0x00b3, {0, 0}, {0x20, ALTGR}},            /* superscript three */
+{0x00b4, {0x2e, 0}, {0x2c, 0}},             /* acute accent */
+{0x00b5, {0, 0}, {0x10, ALTGR}},            /* micro sign */
+{0x00c0, {0x2e, SHIFT}, {0x04, SHIFT}},     /* latin capital letter a with grave */
+{0x00c1, {0x2e, 0}, {0x04, SHIFT}},         /* latin capital letter a with acute */
+{0x00c2, {0x35, 0}, {0x04, SHIFT}},         /* latin capital letter a with circumflex */
+{0x00c4, {0, 0}, {0x34, SHIFT}},            /* latin capital letter a with diaeresis */
+{0x00c8, {0x2e, SHIFT}, {0x08, SHIFT}},     /* latin capital letter e with grave */
+{0x00c9, {0x2e, 0}, {0x08, SHIFT}},         /* latin capital letter e with acute */
+{0x00ca, {0x35, 0}, {0x08, SHIFT}},         /* latin capital letter e with circumflex */
+{0x00cc, {0x2e, SHIFT}, {0x0c, SHIFT}},     /* latin capital letter i with grave */
+{0x00cd, {0x2e, 0}, {0x0c, SHIFT}},         /* latin capital letter i with acute */
+{0x00ce, {0x35, 0}, {0x0c, SHIFT}},         /* latin capital letter i with circumflex */
+{0x00d2, {0x2e, SHIFT}, {0x12, SHIFT}},     /* latin capital letter o with grave */
+{0x00d3, {0x2e, 0}, {0x12, SHIFT}},         /* latin capital letter o with acute */
+{0x00d4, {0x35, 0}, {0x12, SHIFT}},         /* latin capital letter o with circumflex */
+{0x00d6, {0, 0}, {0x33, SHIFT}},            /* latin capital letter o with diaeresis */
+{0x00d9, {0x2e, SHIFT}, {0x18, SHIFT}},     /* latin capital letter u with grave */
+{0x00da, {0x2e, 0}, {0x18, SHIFT}},         /* latin capital letter u with acute */
+{0x00db, {0x35, 0}, {0x18, SHIFT}},         /* latin capital letter u with circumflex */
+{0x00dc, {0, 0}, {0x2f, SHIFT}},            /* latin capital letter u with diaeresis */
+{0x00df, {0, 0}, {0x2d, 0}},                /* latin small letter sharp s */
+{0x00e0, {0x2e, SHIFT}, {0x04, 0}},         /* latin small letter a with grave */
+{0x00e1, {0x2e, 0}, {0x04, 0}},             /* latin small letter a with acute */
+{0x00e2, {0x35, 0}, {0x04, 0}},             /* latin small letter a with circumflex */
+{0x00e4, {0, 0}, {0x34, 0}},                /* latin small letter a with diaeresis */
+{0x00e8, {0x2e, SHIFT}, {0x08, 0}},         /* latin small letter e with grave */
+{0x00e9, {0x2e, 0}, {0x08, 0}},             /* latin small letter e with acute */
+{0x00ea, {0x35, 0}, {0x08, 0}},             /* latin small letter e with circumflex */
+{0x00ec, {0x2e, SHIFT}, {0x0c, 0}},         /* latin small letter i with grave */
+{0x00ed, {0x2e, 0}, {0x0c, 0}},             /* latin small letter i with acute */
+{0x00ee, {0x35, 0}, {0x0c, 0}},             /* latin small letter i with circumflex */
+{0x00f2, {0x2e, SHIFT}, {0x12, 0}},         /* latin small letter o with grave */
+{0x00f3, {0x2e, 0}, {0x12, 0}},             /* latin small letter o with acute */
+{0x00f4, {0x35, 0}, {0x12, 0}},             /* latin small letter o with circumflex */
+{0x00f6, {0, 0}, {0x33, 0}},                /* latin small letter o with diaeresis */
+{0x00f9, {0x2e, SHIFT}, {0x18, 0}},         /* latin small letter u with grave */
+{0x00fa, {0x2e, 0}, {0x18, 0}},             /* latin small letter u with acute */
+{0x00fb, {0x35, 0}, {0x18, 0}},             /* latin small letter u with circumflex */
+{0x00fc, {0, 0}, {0x2f, 0}},                /* latin small letter u with diaeresis */
+{0x20ac, {0, 0}, {0x08, ALTGR}},            /* euro sign */
+};
+
+/* French keyboard, characters beyond the ASCII table */
+static const KEYMAP_EXTENDED extendedFR[] = {
+{0x0060, {0x24, ALTGR}, {0x2c, 0}},         /* ` */
+{0x007e, {0x1f, ALTGR}, {0x2c, 0}},         /* ~ */
+{0x00a3, {0, 0}, {0x30, SHIFT}},            /* pound sign */
+{0x00a4, {0, 0}, {0x30, ALTGR}},            /* currency sign */
+{0x00a7, {0, 0}, {0x38, SHIFT}},            /* section sign */
+{0x00a8, {0x2f, SHIFT}, {0x2c, 0}},         /* diaeresis */
+{0x00b0, {0, 0}, {0x2d, SHIFT}},            /* degree sign */
+{0x00b2, {0, 0}, {0x35, 0}},                /* superscript two */
+{0x00b5, {0, 0}, {0x32, SHIFT}},            /* micro sign */
+{0x00c0, {0x24, ALTGR}, {0x14, SHIFT}},     /* latin capital letter a with grave */
+{0x00c2, {0x2f, 0}, {0x14, SHIFT}},         /* latin capital letter a with circumflex */
+{0x00c3, {0x1f, ALTGR}, {0x14, SHIFT}},     /* latin capital letter a with tilde */
+{0x00c4, {0x2f, SHIFT}, {0x14, SHIFT}},     /* latin capital letter a with diaeresis */
+{0x00c8, {0x24, ALTGR}, {0x08, SHIFT}},     /* latin capital letter e with grave */
+{0x00ca, {0x2f, 0}, {0x08, SHIFT}},         /* latin capital letter e with circumflex */
+{0x00cb, {0x2f, SHIFT}, {0x08, SHIFT}},     /* latin capital letter e with diaeresis */
+{0x00cc, {0x24, ALTGR}, {0x0c, SHIFT}},     /* latin capital letter i with grave */
+{0x00ce, {0x2f, 0}, {0x0c, SHIFT}},         /* latin capital letter i with circumflex */
+{0x00cf, {0x2f, SHIFT}, {0x0c, SHIFT}},     /* latin capital letter i with diaeresis */
+{0x00d1, {0x1f, ALTGR}, {0x11, SHIFT}},     /* latin capital letter n with tilde */
+{0x00d2, {0x24, ALTGR}, {0x12, SHIFT}},     /* latin capital letter o with grave */
+{0x00d4, {0x2f, 0}, {0x12, SHIFT}},         /* latin capital letter o with circumflex */
+{0x00d5, {0x1f, ALTGR}, {0x12, SHIFT}},     /* latin capital letter o with tilde */
+{0x00d6, {0x2f, SHIFT}, {0x12, SHIFT}},     /* latin capital letter o with diaeresis */
+{0x00d9, {0x24, ALTGR}, {0x18, SHIFT}},     /* latin capital letter u with grave */
+{0x00db, {0x2f, 0}, {0x18, SHIFT}},         /* latin capital letter u with circumflex */
+{0x00dc, {0x2f, SHIFT}, {0x18, SHIFT}},     /* latin capital letter u with diaeresis */
+{0x00e0, {0, 0}, {0x27, 0}},                /* latin small letter a with grave */
+{0x00e2, {0x2f, 0}, {0x14, 0}},             /* latin small letter a with circumflex */
+{0x00e3, {0x1f, ALTGR}, {0x14, 0}},         /* latin small letter a with tilde */
+{0x00e4, {0x2f, SHIFT}, {0x14, 0}},         /* latin small letter a with diaeresis */
+{0x00e7, {0, 0}, {0x26, 0}},                /* latin small letter c with cedilla */
+{0x00e8, {0, 0}, {0x24, 0}},                /* latin small letter e with grave */
+{0x00e9, {0, 0}, {0x1f, 0}},                /* latin small letter e with acute */
+{0x00ea, {0x2f, 0}, {0x08, 0}},             /* latin small letter e with circumflex */
+{0x00eb, {0x2f, SHIFT}, {0x08, 0}},         /* latin small letter e with diaeresis */
+{0x00ec, {0x24, ALTGR}, {0x0c, 0}},         /* latin small letter i with grave */
+{0x00ee, {0x2f, 0}, {0x0c, 0}},             /* latin small letter i with circumflex */
+{0x00ef, {0x2f, SHIFT}, {0x0c, 0}},         /* latin small letter i with diaeresis */
+{0x00f1, {0x1f, ALTGR}, {0x11, 0}},         /* latin small letter n with tilde */
+{0x00f2, {0x24, ALTGR}, {0x12, 0}},         /* latin small letter o with grave */
+{0x00f4, {0x2f, 0}, {0x12, 0}},             /* latin small letter o with circumflex */
+{0x00f5, {0x1f, ALTGR}, {0x12, 0}},         /* latin small letter o with tilde */
+{0x00f6, {0x2f, SHIFT}, {0x12, 0}},         /* latin small letter o with diaeresis */
+{0x00f9, {0, 0}, {0x34, 0}},                /* latin small letter u with grave */
+{0x00fb, {0x2f, 0}, {0x18, 0}},             /* latin small letter u with circumflex */
+{0x00fc, {0x2f, SHIFT}, {0x18, 0}},         /* latin small letter u with diaeresis */
+{0x00ff, {0x2f, SHIFT}, {0x1c, 0}},         /* latin small letter y with diaeresis */
+{0x0178, {0x2f, SHIFT}, {0x1c, SHIFT}},     /* latin capital letter y with diaeresis */
+{0x20ac, {0, 0}, {0x08, ALTGR}},            /* euro sign */
+};
+
+#define EXTENDED_SIZE(table) (sizeof(table)/sizeof(KEYMAP_EXTENDED))
+
+static const KEYBOARD_LAYOUT layoutUS = {"US", keymapUS, NULL, 0};
+static const KEYBOARD_LAYOUT layoutUK = {"UK", keymapUK, extendedUK, EXTENDED_SIZE(extendedUK)};
+static const KEYBOARD_LAYOUT layoutDE = {"DE", keymapDE, extendedDE, EXTENDED_SIZE(extendedDE)};
+static const KEYBOARD_LAYOUT layoutFR = {"FR", keymapFR, extendedFR, EXTENDED_SIZE(extendedFR)};
+
+const KEYBOARD_LAYOUT *const keyboardLayouts[KEYBOARD_LAYOUTS] = {
+    &layoutUS,
+    &layoutUK,
+    &layoutDE,
+    &layoutFR,
+};
+
+const KEYBOARD_LAYOUT *findKeyboardLayout(const char *name)
+{
+    /* Returns NULL if there is no layout called name */
+    unsigned long i;
+    
+    for (i=0; i<KEYBOARD_LAYOUTS; i++)
+    {
+        if (strcmp(keyboardLayouts[i]->name, name) == 0)
+        {
+            return keyboardLayouts[i];
+        }
+    }
+    return NULL;
+}
+
+unsigned char keyboardLookup(const KEYBOARD_LAYOUT *layout, unsigned short code, KEYMAP *strokes)
+{
+    /* Find the keystrokes that type code; strokes must hold MAX_KEYSTROKES */
+    /* entries. Returns the number of keystrokes, or 0 if code can't be typed. */
+    unsigned long low;
+    unsigned long high;
+    unsigned long middle;
+    const KEYMAP_EXTENDED *entry;
+    
+    if ((code < KEYMAP_SIZE) && (layout->ascii[code].usage != 0))
+    {
+        strokes[0] = layout->ascii[code];
+        return 1;
+    }
+    
+    low = 0;
+    high = layout->extendedSize;
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+        entry = &layout->extended[middle];
+        
+        if (entry->code < code)
+        {
+            low = middle + 1;
+        }
+        else if (entry->code > code)
+        {
+            high = middle;
+        }
+        else if (entry->dead.usage != 0)
+        {
+            strokes[0] = entry->dead;
+            strokes[1] = entry->key;
+            return 2;
+        }
+        else
+        {
+            strokes[0] = entry->key;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+unsigned short decodeUTF8(const char **string)
+{
+    /* Decode one character and advance *string past it. Malformed sequences, */
+    /* overlong forms, surrogates and characters outside the Basic */
+    /* Multilingual Plane give U+FFFD. */
+    static const unsigned long minimum[5] = {0, 0, 0x80, 0x800, 0x10000};
+    const unsigned char *s = (const unsigned char *)*string;
+    unsigned long code;
+    unsigned char length;
+    unsigned char i;
+    
+    if (s[0] < 0x80)
+    {
+        *string += 1;
+        return s[0];
+    }
+    else if ((s[0] & 0xe0) == 0xc0)
+    {
+        code = s[0] & 0x1f;
+        length = 2;
+    }
+    else if ((s[0] & 0xf0) == 0xe0)
+    {
+        code = s[0] & 0x0f;
+        length = 3;
+    }
+    else if ((s[0] & 0xf8) == 0xf0)
+    {
+        code = s[0] & 0x07;
+        length = 4;
+    }
+    else
+    {
+        /* Stray continuation byte or invalid lead byte */
+        *string += 1;
+        return 0xfffd;
+    }
+    
+    for (i=1; i<length; i++)
+    {
+        if ((s[i] & 0xc0) != 0x80)
+        {
+            /* Truncated; resume at the byte that broke the sequence */
+            *string += i;
+            return 0xfffd;
+        }
+        code = (code << 6) | (s[i] & 0x3f);
+    }
+    
+    *string += length;
+    
+    if ((code < minimum[length]) || ((code >= 0xd800) && (code <= 0xdfff)) || (code > 0xffff))
+    {
+        /* Overlong, a surrogate or outside the BMP */
+        return 0xfffd;
+    }
+    return code;
+}
@@ -0,0 +1,58 @@
+/* keyreports.h */
+/* Keyboard reports for constant text, built at compile time */
+
+/* Needs C++14. The text is turned into one press report per character  */
+/* using the compile-time default keymap (US_KEYBOARD), so the host must */
+/* use that layout. Each press is followed by an all zero release when   */
+/* sent. Characters the keymap can't type directly fail to compile.      */
+/*                                                                       */
+/* Example:                                                              */
+/*   KEY_REPORTS_TEXT(banner, "login: admin\n");                         */
+/*   hid.keyboardReports(banner.report, banner.count);                   */
+
+#ifndef KEYREPORTS_H
+#define KEYREPORTS_H
+
+#include "asciihid.h"
+
+#if __cplusplus >= 201402L
+
+#include "keymaps.h"
+
+template <unsigned long N>
+struct KEY_REPORTS {
+    unsigned long count;
+    KEY_REPORT report[N];    /* One spare so empty text is valid */
+};
+
+/* Not constexpr; reaching it makes the text fail to compile */
+void characterNotInKeymap(void);
+
+template <unsigned long N>
+constexpr KEY_REPORTS<N> compileKeyReports(const KEYMAP *keymap, const char (&text)[N])
+{
+    KEY_REPORTS<N> reports = {};
+    unsigned char c = 0;
+    unsigned long i = 0;
+    
+    for (i=0; i<N-1; i++)
+    {
+        c = text[i];
+        if ((c >= KEYMAP_SIZE) || (keymap[c].usage == 0))
+        {
+            characterNotInKeymap();
+        }
+        reports.report[i].data[0] = keymap[c].modifier;
+        reports.report[i].data[2] = keymap[c].usage;
+    }
+    reports.count = N-1;
+    return reports;
+}
+
+/* Define name as the reports for text, stored in flash */
+#define KEY_REPORTS_TEXT(name, text) \
+    static constexpr auto name = compileKeyReports(DEFAULT_KEYMAP, text)
+
+#endif
+
+#endif
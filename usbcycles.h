@@ -0,0 +1,64 @@
+/* usbcycles.h */
+/* Cortex-M3 DWT cycle counter */
+
+#ifndef USBCYCLES_H
+#define USBCYCLES_H
+
+/* Data Watchpoint and Trace registers */
+#define DWT_CTRL   (*(volatile unsigned long *)0xE0001000)
+#define DWT_CYCCNT (*(volatile unsigned long *)0xE0001004)
+#define DEMCR      (*(volatile unsigned long *)0xE000EDFC)
+
+#define DWT_CTRL_CYCCNTENA (1<<0)
+#define DEMCR_TRCENA       (1<<24)
+
+typedef struct {
+    unsigned long      count;
+    unsigned long long total;
+    unsigned long      min;
+    unsigned long      max;
+} CYCLE_STATISTICS;
+
+inline void cycleCounterEnable(void)
+{
+    /* Enable the trace block and start the cycle counter. A counter */
+    /* already running is left alone, as other users may be timing with it; */
+    /* only differences between reads are meaningful. */
+    if ((DEMCR & DEMCR_TRCENA) && (DWT_CTRL & DWT_CTRL_CYCCNTENA))
+    {
+        return;
+    }
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+inline unsigned long cycleCounterRead(void)
+{
+    return DWT_CYCCNT;
+}
+
+inline void cycleStatisticsReset(CYCLE_STATISTICS *statistics)
+{
+    statistics->count = 0;
+    statistics->total = 0;
+    statistics->min = 0xffffffff;
+    statistics->max = 0;
+}
+
+inline void cycleStatisticsAdd(CYCLE_STATISTICS *statistics, unsigned long cycles)
+{
+    statistics->count++;
+    statistics->total += cycles;
+    
+    if (cycles < statistics->min)
+    {
+        statistics->min = cycles;
+    }
+    
+    if (cycles > statistics->max)
+    {
+        statistics->max = cycles;
+    }
+}
+
+#endif
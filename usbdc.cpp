@@ -78,6 +78,27 @@
 #define SIE_DS_SUS_CH (1<<3)
 #define SIE_DS_RST    (1<<4)
 
+/* SIE Get Error Code register */
+#define SIE_EC_CODE_MASK      (0x0f)
+#define SIE_EC_PID_ENCODING   (0x1)
+#define SIE_EC_PID_UNKNOWN    (0x2)
+#define SIE_EC_UNEXPECTED     (0x3)
+#define SIE_EC_TOKEN_CRC      (0x4)
+#define SIE_EC_DATA_CRC       (0x5)
+#define SIE_EC_TIMEOUT        (0x6)
+#define SIE_EC_BABBLE         (0x7)
+#define SIE_EC_EOP            (0x8)
+#define SIE_EC_NAK            (0x9)
+#define SIE_EC_STALL          (0xa)
+#define SIE_EC_OVERRUN        (0xb)
+#define SIE_EC_EMPTY_PACKET   (0xc)
+#define SIE_EC_BIT_STUFF      (0xd)
+#define SIE_EC_SYNC           (0xe)
+#define SIE_EC_TOGGLE         (0xf)
+
+/* SIE Read Frame Number register */
+#define FRAME_NUMBER_MASK (0x7ff)
+
 /* SIE Device Set Address register */
 #define SIE_DSA_DEV_EN  (1<<7)
 
@@ -99,6 +120,8 @@
 #define SIE_SES_RF_MO   (1<<6)
 #define SIE_SES_CND_ST  (1<<7)
 
+/* There is one USB controller and one USB IRQ; this is only used to route */
+/* the IRQ to the object driving it. All other state is per instance. */
 usbdc *usbdc::instance;
 
 usbdc::usbdc()
@@ -134,10 +157,31 @@ usbdc::usbdc()
     /* Connect must be low for at least 2.5uS */
     wait_ms(1);
     
+    /* Device status is cached; only the CON bit is ever written */
+    deviceStatus = 0;
+    servicePending = false;
+    resetSIEStatistics();
+    resetErrorStatistics();
+#ifdef USB_PCAP
+    capture = NULL;
+    captureAddress = 0;
+    setupPacket = false;
+#endif
+#ifdef USB_PROFILE
+    cycleCounterEnable();
+#endif
+    profileReset();
+    
     /* Attach IRQ */
     instance = this;
     NVIC_SetVector(USB_IRQn, (uint32_t)&_usbisr);
+#ifdef USB_POLLED
+    /* Interrupts stay disabled; the application must call poll() */
+    polled = true;
+#else
+    polled = false;
     NVIC_EnableIRQ(USB_IRQn); 
+#endif
 
     /* Enable device interrupts */
     enableEvents();
@@ -146,32 +190,236 @@ usbdc::usbdc()
 void usbdc::connect(void)
 {
     /* Connect USB device */
-    unsigned char status;
-    
-    status = getDeviceStatus();
-    setDeviceStatus(status | SIE_DS_CON);
+    deviceStatus |= SIE_DS_CON;
+    setDeviceStatus(deviceStatus);
 }
 
 void usbdc::disconnect(void)
 {
     /* Disconnect USB device */
-    unsigned char status;
+    deviceStatus &= ~SIE_DS_CON;
+    setDeviceStatus(deviceStatus);
+}
+
+void usbdc::setPolled(bool enable)
+{
+    /* Select polled (interrupt-free) or interrupt driven operation */
+    polled = enable;
+    
+    if (polled)
+    {
+        NVIC_DisableIRQ(USB_IRQn);
+    }
+    else
+    {
+        NVIC_EnableIRQ(USB_IRQn);
+    }
+}
+
+void usbdc::requestService(void)
+{
+    /* Ask for deviceEventService() to be called from the USB interrupt, or */
+    /* the next poll(). Safe from any context; touches no SIE registers. */
+    servicePending = true;
+    
+    if (!polled)
+    {
+        NVIC_SetPendingIRQ(USB_IRQn);
+    }
+}
+
+unsigned long usbdc::poll(void)
+{
+    /* Process any pending device and endpoint events synchronously. */
+    /* Returns the number of events processed. */
+    /* Interrupts are masked so that no other interrupt can start an SIE */
+    /* command sequence part way through one of ours. */
+    unsigned long events;
+    uint32_t primask = __get_PRIMASK();
+    
+    __disable_irq();
+    events = usbisr();
+    __set_PRIMASK(primask);
+    return events;
+}
+
+void usbdc::idle(void)
+{
+    /* Called from busy-wait loops; in polled mode nothing else will */
+    /* process the events being waited for */
+    if (polled)
+    {
+        poll();
+    }
+}
+
+#ifdef USB_PCAP
+void usbdc::setCapture(usbpcap *pcap)
+{
+    /* Record transactions to a pcap capture; NULL stops recording */
+    capture = pcap;
+}
+
+void usbdc::capturePacket(unsigned char endpoint, unsigned char *data, unsigned long length)
+{
+    /* Record a transaction on a physical endpoint */
+    unsigned char transferType;
+    unsigned char address = endpoint >> 1;
+    
+    if (capture == NULL)
+    {
+        return;
+    }
+    
+    if ((endpoint == EP0OUT) && setupPacket)
+    {
+        capture->setup(captureAddress, data);
+        return;
+    }
+    
+    switch (address)
+    {
+        case 0:
+            transferType = PCAP_CONTROL;
+            break;
+        case 1:
+            transferType = PCAP_INTERRUPT;
+            break;
+        default:
+            transferType = PCAP_BULK;
+            break;
+    }
+    
+    if (endpoint & 1)
+    {
+        /* IN data is seen by the host as a completion */
+        capture->packet(PCAP_COMPLETE, transferType, address | 0x80, captureAddress, data, length);
+    }
+    else
+    {
+        /* OUT data is carried by the submission */
+        capture->packet(PCAP_SUBMIT, transferType, address, captureAddress, data, length);
+    }
+}
+#endif
+
+#ifdef USB_TRACE
+usbtrace *usbdc::getTrace(void)
+{
+    /* The trace of SIE commands, interrupts and endpoint events */
+    return &trace;
+}
+#endif
+
+void usbdc::getSIEStatistics(SIE_STATISTICS *statistics)
+{
+    /* Copy the SIE transaction counters */
+    *statistics = sieStatistics;
+}
+
+void usbdc::resetSIEStatistics(void)
+{
+    /* Clear the SIE transaction counters */
+    sieStatistics.commands = 0;
+    sieStatistics.writes = 0;
+    sieStatistics.reads = 0;
+}
+
+void usbdc::getErrorStatistics(USB_ERROR_STATISTICS *statistics)
+{
+    /* Copy the link error counters */
+    *statistics = errorStatistics;
+}
+
+void usbdc::resetErrorStatistics(void)
+{
+    /* Clear the link error counters */
+    errorStatistics.pid = 0;
+    errorStatistics.crc = 0;
+    errorStatistics.timeout = 0;
+    errorStatistics.bitStuff = 0;
+    errorStatistics.sync = 0;
+    errorStatistics.overrun = 0;
+    errorStatistics.retries = 0;
+    errorStatistics.other = 0;
+    errorStatistics.naks = 0;
+}
+
+void usbdc::errorEvent(void)
+{
+    /* Read and classify the last SIE error */
+    unsigned char code;
+    
+    SIECommand(SIE_CMD_GET_ERROR_CODE);
+    code = SIEReadData(SIE_CMD_GET_ERROR_CODE) & SIE_EC_CODE_MASK;
+    
+    switch (code)
+    {
+        case SIE_EC_PID_ENCODING:
+        case SIE_EC_PID_UNKNOWN:
+            errorStatistics.pid++;
+            break;
+        case SIE_EC_TOKEN_CRC:
+        case SIE_EC_DATA_CRC:
+            errorStatistics.crc++;
+            break;
+        case SIE_EC_TIMEOUT:
+            errorStatistics.timeout++;
+            break;
+        case SIE_EC_BIT_STUFF:
+            errorStatistics.bitStuff++;
+            break;
+        case SIE_EC_SYNC:
+            errorStatistics.sync++;
+            break;
+        case SIE_EC_OVERRUN:
+            errorStatistics.overrun++;
+            break;
+        case SIE_EC_TOGGLE:
+            errorStatistics.retries++;
+            break;
+        case SIE_EC_UNEXPECTED:
+        case SIE_EC_BABBLE:
+        case SIE_EC_EOP:
+            errorStatistics.other++;
+            break;
+        default:
+            /* No error, stall or empty packet; a NAK is counted by */
+            /* countNak() instead, so it is not counted twice */
+            break;
+    }
     
-    status = getDeviceStatus();
-    setDeviceStatus(status & ~SIE_DS_CON);
+    /* Reading the error status register clears it */
+    SIECommand(SIE_CMD_READ_ERROR_STATUS);
+    SIEReadData(SIE_CMD_READ_ERROR_STATUS);
+}
+
+void usbdc::countNak(unsigned char status)
+{
+    /* Count NAKs reported in the select endpoint status of an IN endpoint */
+    if (status & SIE_SE_EPN)
+    {
+        errorStatistics.naks++;
+    }
 }
 
 void usbdc::SIECommand(unsigned long command)
 {
     /* The command phase of a SIE transaction */
+    PROFILE_BEGIN(PROFILE_SIE_COMMAND);
+    sieStatistics.commands++;
+    TRACE(TRACE_SIE_COMMAND, 0, command);
     LPC_USB->USBDevIntClr = CCEMPTY;
     LPC_USB->USBCmdCode = SIE_CMD_CODE(SIE_COMMAND, command);
     while (!(LPC_USB->USBDevIntSt & CCEMPTY)); 
+    PROFILE_END(PROFILE_SIE_COMMAND);
 }
 
 void usbdc::SIEWriteData(unsigned char data)
 {
     /* The data write phase of a SIE transaction */
+    sieStatistics.writes++;
+    TRACE(TRACE_SIE_WRITE, 0, data);
     LPC_USB->USBDevIntClr = CCEMPTY;
     LPC_USB->USBCmdCode = SIE_CMD_CODE(SIE_WRITE, data);
     while (!(LPC_USB->USBDevIntSt & CCEMPTY)); 
@@ -180,10 +428,15 @@ void usbdc::SIEWriteData(unsigned char data)
 unsigned char usbdc::SIEReadData(unsigned long command)
 {
     /* The data read phase of a SIE transaction */
+    unsigned char data;
+    
+    sieStatistics.reads++;
     LPC_USB->USBDevIntClr = CDFULL;
     LPC_USB->USBCmdCode = SIE_CMD_CODE(SIE_READ, command);
     while (!(LPC_USB->USBDevIntSt & CDFULL));
-    return (unsigned char)LPC_USB->USBCmdData;
+    data = (unsigned char)LPC_USB->USBCmdData;
+    TRACE(TRACE_SIE_READ, 0, data);
+    return data;
 }
 
 void usbdc::setDeviceStatus(unsigned char status)
@@ -205,6 +458,9 @@ void usbdc::setAddress(unsigned char address)
     /* Write SIE device address register */
     SIECommand(SIE_CMD_SET_ADDRESS);
     SIEWriteData((address & 0x7f) | SIE_DSA_DEV_EN);
+#ifdef USB_PCAP
+    captureAddress = address & 0x7f;
+#endif
 }
 
 unsigned char usbdc::selectEndpoint(unsigned char endpoint)
@@ -220,9 +476,13 @@ unsigned char usbdc::selectEndpointClearInterrupt(unsigned char endpoint)
     /* SIE select endpoint and clear interrupt command */
     /* Using the Select Endpoint / Clear Interrupt SIE command does not seem   */
     /* to clear the appropriate bit in EP_INT_STAT? - using EP_INT_CLR instead */
+    unsigned char status;
+    
     LPC_USB->USBEpIntClr = EP(endpoint);
     while (!(LPC_USB->USBDevIntSt & CDFULL));
-    return (unsigned char)LPC_USB->USBCmdData;
+    status = (unsigned char)LPC_USB->USBCmdData;
+    TRACE(TRACE_EP_EVENT, endpoint, status);
+    return status;
 }
 #else
 unsigned char usbdc::selectEndpointClearInterrupt(unsigned char endpoint)
@@ -233,11 +493,11 @@ unsigned char usbdc::selectEndpointClearInterrupt(unsigned char endpoint)
 }
 #endif
 
-unsigned char usbdc::clearBuffer(void)
+void usbdc::clearBuffer(void)
 {
     /* SIE clear buffer command */
+    /* The data phase (packet overwritten flag) is optional and is not read */
     SIECommand(SIE_CMD_CLEAR_BUFFER);
-    return SIEReadData(SIE_CMD_CLEAR_BUFFER);
 }
 
 void usbdc::validateBuffer(void)
@@ -312,6 +572,39 @@ bool usbdc::getEndpointStallState(unsigned char endpoint)
     return endpointStallState & EP(endpoint);
 }
 
+unsigned char usbdc::endpointBuffersFull(unsigned char endpoint)
+{
+    /* Returns the number of full buffers (0, 1 or 2) of a double buffered endpoint */
+    unsigned char status;
+    unsigned char full = 0;
+    
+    status = selectEndpoint(endpoint);
+    
+    if (status & SIE_SE_B_1_FULL)
+    {
+        full++;
+    }
+    
+    if (status & SIE_SE_B_2_FULL)
+    {
+        full++;
+    }
+    
+    return full;
+}
+
+unsigned short usbdc::getFrameNumber(void)
+{
+    /* SIE read frame number command; returns the 11-bit frame number */
+    unsigned short frame;
+    
+    SIECommand(SIE_CMD_READ_FRAME_NUMBER);
+    frame = SIEReadData(SIE_CMD_READ_FRAME_NUMBER);
+    frame |= (unsigned short)SIEReadData(SIE_CMD_READ_FRAME_NUMBER) << 8;
+    
+    return frame & FRAME_NUMBER_MASK;
+}
+
 void usbdc::configureDevice(void)
 {
     /* SIE Configure device command */
@@ -326,18 +619,23 @@ void usbdc::unconfigureDevice(void)
     SIEWriteData(0);
 }    
 
-unsigned long usbdc::endpointRead(unsigned char endpoint, unsigned char *buffer)
+unsigned long usbdc::endpointRead(unsigned char endpoint, unsigned char *buffer, unsigned long maxSize)
 {
-    /* Read from an OUT endpoint */
+    /* Read from an OUT endpoint. At most maxSize bytes are stored; any further */
+    /* bytes are discarded. Returns the size of the packet received. */
     unsigned long size;
     unsigned long i;
     unsigned long data;
     unsigned char offset;
+#ifdef USB_PCAP
+    unsigned char *packet = buffer;
+#endif
     
     LPC_USB->USBCtrl = LOG_ENDPOINT(endpoint) | RD_EN;
     while (!(LPC_USB->USBRxPLen & PKT_RDY));
         
     size = LPC_USB->USBRxPLen & PKT_LNGTH_MASK;
+    TRACE(TRACE_EP_READ, endpoint, size);
         
     offset = 0;
     
@@ -350,7 +648,10 @@ unsigned long usbdc::endpointRead(unsigned char endpoint, unsigned char *buffer)
         }
     
         /* extract a byte */
-        *buffer++ = data>>offset;
+        if (i<maxSize)
+        {
+            *buffer++ = data>>offset;
+        }
     
         /* move on to the next byte */
         offset = (offset + 8) % 32;
@@ -359,9 +660,13 @@ unsigned long usbdc::endpointRead(unsigned char endpoint, unsigned char *buffer)
     /* Clear RD_EN to cover zero length packet case */
     LPC_USB->USBCtrl=0;
     
-    selectEndpoint(endpoint);
+    /* Select endpoint; the data phase is optional and is not read */
+    SIECommand(SIE_CMD_SELECT_ENDPOINT(endpoint));
     clearBuffer();
     
+#ifdef USB_PCAP
+    capturePacket(endpoint, packet, (size < maxSize) ? size : maxSize);
+#endif
     return size;
 }
 
@@ -370,10 +675,16 @@ void usbdc::endpointWrite(unsigned char endpoint, unsigned char *buffer, unsigne
     /* Write to an IN endpoint */
     unsigned long temp, data;
     unsigned char offset;
+    PROFILE_BEGIN(PROFILE_ENDPOINT_WRITE);
+    
+#ifdef USB_PCAP
+    capturePacket(endpoint, buffer, size);
+#endif
     
     LPC_USB->USBCtrl = LOG_ENDPOINT(endpoint) | WR_EN;
     
     LPC_USB->USBTxPLen = size;    
+    TRACE(TRACE_EP_WRITE, endpoint, size);
     offset = 0;
     data = 0;
     
@@ -403,30 +714,38 @@ void usbdc::endpointWrite(unsigned char endpoint, unsigned char *buffer, unsigne
     /* Clear WR_EN to cover zero length packet case */
     LPC_USB->USBCtrl=0;
     
-    selectEndpoint(endpoint);
+    /* Select endpoint; the data phase is optional and is not read */
+    SIECommand(SIE_CMD_SELECT_ENDPOINT(endpoint));
     validateBuffer();
+    PROFILE_END(PROFILE_ENDPOINT_WRITE);
 }
 
 void usbdc::enableEvents(void)
 {
     /* Enable interrupt sources */
-    LPC_USB->USBDevIntEn = EP_SLOW | DEV_STAT;
+    LPC_USB->USBDevIntEn = EP_SLOW | DEV_STAT | ERR_INT;
 }
 
 void usbdc::disableEvents(void)
 {
     /* Disable interrupt sources */
-    LPC_USB->USBDevIntClr = EP_SLOW | DEV_STAT;
+    /* Mask rather than clear, so pending events are not lost */
+    LPC_USB->USBDevIntEn &= ~(EP_SLOW | DEV_STAT | ERR_INT);
 }
 
-void usbdc::usbisr(void)
+unsigned long usbdc::usbisr(void)
 { 
     unsigned char devStat;
+    unsigned long events = 0;
+    PROFILE_BEGIN(PROFILE_ISR);
+    
+    TRACE(TRACE_ISR, LPC_USB->USBEpIntSt, LPC_USB->USBDevIntSt);
     
     if (LPC_USB->USBDevIntSt & FRAME)
     {
         /* Frame event */
         deviceEventFrame();
+        events++;
         /* Clear interrupt status flag */
         LPC_USB->USBDevIntClr = FRAME;
     }
@@ -442,9 +761,19 @@ void usbdc::usbisr(void)
         
         if (devStat & SIE_DS_RST)
         {
+            TRACE(TRACE_RESET, 0, devStat);
             /* Bus reset */
             deviceEventReset();
         }
+        events++;
+    }
+    
+    if (LPC_USB->USBDevIntSt & ERR_INT)
+    {
+        /* Error interrupt */
+        LPC_USB->USBDevIntClr = ERR_INT;
+        errorEvent();
+        events++;
     }
     
     if (LPC_USB->USBDevIntSt & EP_SLOW)
@@ -457,48 +786,74 @@ void usbdc::usbisr(void)
             if (selectEndpointClearInterrupt(EP0OUT) & SIE_SE_STP)
             {
                 /* this is a setup packet */
+#ifdef USB_PCAP
+                setupPacket = true;
                 endpointEventEP0Setup();
+                setupPacket = false;
+#else
+                endpointEventEP0Setup();
+#endif
             }
             else
             {
                 endpointEventEP0Out();
             }
+            events++;
         }
 
         if (LPC_USB->USBEpIntSt & EP(EP0IN))
         {
-            selectEndpointClearInterrupt(EP0IN);
+            countNak(selectEndpointClearInterrupt(EP0IN));
             endpointEventEP0In();
+            events++;
         }
         
         if (LPC_USB->USBEpIntSt & EP(EP1OUT))
         {
             selectEndpointClearInterrupt(EP1OUT);
             endpointEventEP1Out();
+            events++;
         }    
         
         if (LPC_USB->USBEpIntSt & EP(EP1IN))
         {
-            selectEndpointClearInterrupt(EP1IN);
+            countNak(selectEndpointClearInterrupt(EP1IN));
             endpointEventEP1In();
+            events++;
         }    
         
         if (LPC_USB->USBEpIntSt & EP(EP2OUT))
         {
             selectEndpointClearInterrupt(EP2OUT);
             endpointEventEP2Out();
+            events++;
         }    
         
         if (LPC_USB->USBEpIntSt & EP(EP2IN))
         {
-            selectEndpointClearInterrupt(EP2IN);
+            countNak(selectEndpointClearInterrupt(EP2IN));
             endpointEventEP2In();
+            events++;
         }    
         
         /* Clear interrupt status flag */
         /* EP_SLOW and EP_FAST interrupt bits should be cleared after the corresponding endpoint interrupts are cleared. */
         LPC_USB->USBDevIntClr = EP_SLOW;
     }
+    
+    if (servicePending)
+    {
+        /* Requested with requestService() */
+        servicePending = false;
+        deviceEventService();
+        events++;
+    }
+    
+    if (events > 0)
+    {
+        PROFILE_END(PROFILE_ISR);
+    }
+    return events;
 }
 
 
@@ -515,6 +870,10 @@ void usbdc::deviceEventFrame(void)
 {
 }
 
+void usbdc::deviceEventService(void)
+{
+}
+
 void usbdc::endpointEventEP0Setup(void)
 {
 }
@@ -15,12 +15,56 @@
 
 #include "mbed.h"
 
+#include "usbprofile.h"
+
+#ifdef USB_PCAP
+#include "usbpcap.h"
+#endif
+
+#ifdef USB_TRACE
+#include "usbtrace.h"
+#define TRACE(type, endpoint, data) trace.record(type, endpoint, data)
+#else
+#define TRACE(type, endpoint, data)
+#endif
+
+typedef struct {
+    unsigned long commands; /* SIE command phases */
+    unsigned long writes;   /* SIE data write phases */
+    unsigned long reads;    /* SIE data read phases */
+} SIE_STATISTICS;
+
+typedef struct {
+    unsigned long pid;      /* PID encoding and unknown PID errors */
+    unsigned long crc;      /* Token and data CRC errors */
+    unsigned long timeout;  /* Bus time-out errors */
+    unsigned long bitStuff; /* Bit stuff errors */
+    unsigned long sync;     /* Sync errors */
+    unsigned long overrun;  /* Data buffer overrun errors */
+    unsigned long retries;  /* Wrong toggle bit; the host resent a packet */
+    unsigned long other;    /* Unexpected packet, babble and EOP errors */
+    unsigned long naks;     /* IN endpoint events whose select endpoint status */
+                            /* showed a NAK had been sent (not the error code) */
+} USB_ERROR_STATISTICS;
+
 class usbdc : public Base 
 {
 public:
     usbdc();
     void connect(void);
     void disconnect(void);
+    void getSIEStatistics(SIE_STATISTICS *statistics);
+    void resetSIEStatistics(void);
+    void getErrorStatistics(USB_ERROR_STATISTICS *statistics);
+    void resetErrorStatistics(void);
+    void setPolled(bool enable);
+    unsigned long poll(void);
+#ifdef USB_TRACE
+    usbtrace *getTrace(void);
+#endif
+#ifdef USB_PCAP
+    void setCapture(usbpcap *pcap);
+#endif
 protected:
     void setAddress(unsigned char address);
     void realiseEndpoint(unsigned char endpoint, unsigned long maxPacket);
@@ -29,14 +73,19 @@ protected:
     void stallEndpoint(unsigned char endpoint);
     void unstallEndpoint(unsigned char endpoint);
     bool getEndpointStallState(unsigned char endpoint);
+    unsigned char endpointBuffersFull(unsigned char endpoint);
+    unsigned short getFrameNumber(void);
     void configureDevice(void);
     void unconfigureDevice(void);
-    unsigned long endpointRead(unsigned char endpoint, unsigned char *buffer);
+    unsigned long endpointRead(unsigned char endpoint, unsigned char *buffer, unsigned long maxSize);
     void endpointWrite(unsigned char endpoint, unsigned char *buffer, unsigned long size);
     void enableEvents(void);
     void disableEvents(void);    
+    void idle(void);
+    void requestService(void);
     virtual void deviceEventReset(void);
     virtual void deviceEventFrame(void); 
+    virtual void deviceEventService(void);
     virtual void endpointEventEP0Setup(void);
     virtual void endpointEventEP0In(void);
     virtual void endpointEventEP0Out(void);
@@ -44,7 +93,16 @@ protected:
     virtual void endpointEventEP1Out(void);    
     virtual void endpointEventEP2In(void);
     virtual void endpointEventEP2Out(void);        
+#ifdef USB_TRACE
+    usbtrace trace;
+#endif
 private:
+#ifdef USB_PCAP
+    void capturePacket(unsigned char endpoint, unsigned char *data, unsigned long length);
+    usbpcap *capture;
+    unsigned char captureAddress;
+    bool setupPacket;
+#endif
     void SIECommand(unsigned long command);
     void SIEWriteData(unsigned char data);
     unsigned char SIEReadData(unsigned long command);
@@ -53,10 +111,17 @@ private:
     unsigned char getDeviceStatus(void);
     unsigned char selectEndpoint(unsigned char endpoint);
     unsigned char selectEndpointClearInterrupt(unsigned char endpoint);
-    unsigned char clearBuffer(void);
+    void clearBuffer(void);
+    void errorEvent(void);
+    void countNak(unsigned char status);
     void validateBuffer(void);
-    void usbisr(void);
+    unsigned long usbisr(void);
     unsigned long endpointStallState;
+    bool polled;
+    volatile bool servicePending;   /* deviceEventService() is due */
+    unsigned char deviceStatus;
+    SIE_STATISTICS sieStatistics;
+    USB_ERROR_STATISTICS errorStatistics;
     static void _usbisr(void);
     static usbdc *instance;
 };
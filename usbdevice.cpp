@@ -3,6 +3,7 @@
 /* Copyright (c) Phil Wright 2008 */
 
 #include "mbed.h"
+#include "us_ticker_api.h"
 #include "usbdevice.h"
 
 /* Standard requests */
@@ -31,9 +32,6 @@
 /* Macro to convert wIndex endpoint number to physical endpoint number */
 #define WINDEX_TO_PHYSICAL(endpoint) (((endpoint & 0x0f) << 1) + ((endpoint & 0x80) ? 1 : 0))
 
-CONTROL_TRANSFER transfer;
-USB_DEVICE device;
-    
 usbdevice::usbdevice()
 {
     /* Set initial device state */
@@ -41,6 +39,15 @@ usbdevice::usbdevice()
     device.configuration = 0;
     device.suspended = false;
     
+    /* No bulk transfers in progress */
+    bulkInTransfer.active = false;
+    bulkOutTransfer.active = false;
+    setupDecoded = false;
+    
+    /* Time enumeration from power up until the first bus reset */
+    resetEnumerationStatistics();
+    enumerationStart = us_ticker_read();
+    
     /* Set the maximum packet size for the control endpoints */
     realiseEndpoint(EP0IN, MAX_PACKET_SIZE_EP0);
     realiseEndpoint(EP0OUT, MAX_PACKET_SIZE_EP0);
@@ -53,11 +60,74 @@ usbdevice::usbdevice()
 void usbdevice::endpointEventEP0Setup(void)
 {
     /* Endpoint 0 setup event */
+    unsigned long start;
+    
+    start = us_ticker_read();
+    PROFILE_BEGIN(PROFILE_CONTROL_SETUP);
+    
     if (!controlSetup())
     {    
         /* Protocol stall; this will stall both endpoints */
         stallEndpoint(EP0OUT);
     }
+    
+    PROFILE_END(PROFILE_CONTROL_SETUP);
+    
+    /* transfer.setup is stale if the packet could not be read */
+    if (setupDecoded)
+    {
+        recordRequestTime((uint32_t)(us_ticker_read() - start));
+    }
+}
+
+void usbdevice::recordRequestTime(unsigned long time)
+{
+    /* Add the time taken to handle a setup packet to the request statistics */
+    REQUEST_STATISTICS *request;
+    
+    if ((transfer.setup.bmRequestType.Type == STANDARD_TYPE) && (transfer.setup.bRequest < STANDARD_REQUESTS))
+    {
+        request = &enumerationStatistics.standard[transfer.setup.bRequest];
+    }
+    else
+    {
+        request = &enumerationStatistics.other;
+    }
+    
+    request->count++;
+    request->totalTime += time;
+    
+    if (time > request->maxTime)
+    {
+        request->maxTime = time;
+    }
+}
+
+void usbdevice::getEnumerationStatistics(ENUMERATION_STATISTICS *statistics)
+{
+    /* Copy the enumeration timing statistics */
+    *statistics = enumerationStatistics;
+}
+
+void usbdevice::resetEnumerationStatistics(void)
+{
+    /* Clear the enumeration timing statistics */
+    unsigned char i;
+    
+    enumerationStatistics.resets = 0;
+    enumerationStatistics.resetToAddress = 0;
+    enumerationStatistics.resetToConfigured = 0;
+    
+    for (i=0; i<STANDARD_REQUESTS; i++)
+    {
+        enumerationStatistics.standard[i].count = 0;
+        enumerationStatistics.standard[i].totalTime = 0;
+        enumerationStatistics.standard[i].maxTime = 0;
+    }
+    
+    enumerationStatistics.other.count = 0;
+    enumerationStatistics.other.totalTime = 0;
+    enumerationStatistics.other.maxTime = 0;
 }
 
 void usbdevice::endpointEventEP0Out(void)
@@ -85,6 +155,14 @@ void usbdevice::deviceEventReset(void)
     device.state = DEFAULT;
     device.configuration = 0;
     device.suspended = false;
+    
+    /* Time re-enumeration from this bus reset */
+    enumerationStatistics.resets++;
+    enumerationStart = us_ticker_read();
+    
+    /* Any bulk transfers in progress are abandoned */
+    bulkInTransfer.active = false;
+    bulkOutTransfer.active = false;
 }
 
 void usbdevice::decodeSetupPacket(unsigned char *data, SETUP_PACKET *packet)
@@ -105,10 +183,11 @@ bool usbdevice::controlSetup(void)
     unsigned char buffer[MAX_PACKET_SIZE_EP0];
     unsigned long count;
 
-    count = endpointRead(EP0OUT, buffer);
+    count = endpointRead(EP0OUT, buffer, sizeof(buffer));
     
     /* Must be 8 bytes of data */
-    if (count != 8)
+    setupDecoded = (count == 8);
+    if (!setupDecoded)
     {    
         return false;
     }
@@ -119,6 +198,7 @@ bool usbdevice::controlSetup(void)
     transfer.remaining = 0;
     transfer.direction = 0;
     transfer.zlp = false;
+    transfer.notify = NULL;
     
     /* Process request */
     if (!requestSetup())
@@ -199,7 +279,6 @@ bool usbdevice::controlSetup(void)
 bool usbdevice::controlOut(void)
 {    
     /* Control transfer data OUT stage */
-    unsigned char buffer[MAX_PACKET_SIZE_EP0];
     unsigned long packetSize;
 
     /* Check we should be transferring data OUT */
@@ -208,8 +287,8 @@ bool usbdevice::controlOut(void)
         return false;
     }
     
-    /* Read from endpoint */
-    packetSize = endpointRead(EP0OUT, buffer);
+    /* Read from endpoint directly into the destination buffer */
+    packetSize = endpointRead(EP0OUT, transfer.ptr, transfer.remaining);
     
     /* Check if transfer size is valid */
     if (packetSize > transfer.remaining)
@@ -226,9 +305,12 @@ bool usbdevice::controlOut(void)
     if (transfer.remaining == 0)
     {
         /* Process request */        
-        if (!requestOut())
+        if (transfer.notify != NULL)
         {
-            return false;
+            if (!(this->*transfer.notify)())
+            {
+                return false;
+            }
         }
         
         /* Status stage */
@@ -328,11 +410,6 @@ bool usbdevice::requestSetup(void)
     return success;
 }
 
-bool usbdevice::requestOut(void)
-{
-    return true;
-}
-
 bool usbdevice::requestSetAddress(void)
 {
     /* Set the device address */
@@ -345,6 +422,7 @@ bool usbdevice::requestSetAddress(void)
     else
     {
         device.state = ADDRESS;
+        enumerationStatistics.resetToAddress = (uint32_t)(us_ticker_read() - enumerationStart);
     }
         
     return true;
@@ -363,6 +441,7 @@ bool usbdevice::requestSetConfiguration(void)
     {
         configureDevice();
         device.state = CONFIGURED;
+        enumerationStatistics.resetToConfigured = (uint32_t)(us_ticker_read() - enumerationStart);
     }
     
     /* TODO: We do not currently support multiple configurations, just keep a record of the configuration value */
@@ -382,8 +461,6 @@ bool usbdevice::requestGetConfiguration(void)
 
 bool usbdevice::requestGetInterface(void)
 {
-    static unsigned char alternateSetting;
-    
     /* Return the selected alternate setting for an interface */
     
     if (device.state != CONFIGURED)
@@ -476,7 +553,6 @@ bool usbdevice::requestClearFeature()
 
 bool usbdevice::requestGetStatus(void)
 {
-    static unsigned short status;
     bool success = false;
     
     if (device.state != CONFIGURED)
@@ -492,22 +568,22 @@ bool usbdevice::requestGetStatus(void)
     {
         case DEVICE_RECIPIENT:
             /* TODO: Currently only supports self powered devices */
-            status = DEVICE_STATUS_SELF_POWERED;
+            statusReply = DEVICE_STATUS_SELF_POWERED;
             success = true;
             break;
         case INTERFACE_RECIPIENT:
-            status = 0;
+            statusReply = 0;
             success = true;
             break;
         case ENDPOINT_RECIPIENT:
             /* TODO: We should check that the endpoint number is valid */
             if (getEndpointStallState(WINDEX_TO_PHYSICAL(transfer.setup.wIndex)))
             {
-                status = ENDPOINT_STATUS_HALT;
+                statusReply = ENDPOINT_STATUS_HALT;
             }
             else
             {
-                status = 0;
+                statusReply = 0;
             } 
             success = true;
             break;
@@ -518,8 +594,8 @@ bool usbdevice::requestGetStatus(void)
     if (success)
     {
         /* Send the status */ 
-        transfer.ptr = (unsigned char *)&status; /* Assumes little endian */
-        transfer.remaining = sizeof(status); 
+        transfer.ptr = (unsigned char *)&statusReply; /* Assumes little endian */
+        transfer.remaining = sizeof(statusReply); 
         transfer.direction = DEVICE_TO_HOST;
     }
     
@@ -529,4 +605,170 @@ bool usbdevice::requestGetStatus(void)
 bool usbdevice::requestGetDescriptor(void)
 {
     return false;
+}
+
+void usbdevice::realiseBulkEndpoints(void)
+{
+    /* Configure the double buffered bulk endpoints */
+    /* Called by a derived class when its configuration includes EP2 */
+    realiseEndpoint(EP2IN, MAX_PACKET_SIZE_EP2);
+    realiseEndpoint(EP2OUT, MAX_PACKET_SIZE_EP2);
+    enableEndpointEvent(EP2IN);
+    enableEndpointEvent(EP2OUT);
+}
+
+bool usbdevice::bulkIn(unsigned char *data, unsigned long size)
+{
+    /* Start streaming data to the host on EP2IN. bulkInComplete() is */
+    /* called once the last packet has been sent. */
+    uint32_t primask;
+    
+    /* SIE command sequences must not be interleaved with the USB */
+    /* interrupt, poll() or another caller; may be called from an interrupt */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    
+    if (bulkInTransfer.active)
+    {
+        __set_PRIMASK(primask);
+        return false;
+    }
+    
+    bulkInTransfer.ptr = data;
+    bulkInTransfer.remaining = size;
+    bulkInTransfer.size = size;
+    bulkInTransfer.active = true;
+    
+    /* A short packet is needed to end a transfer of whole packets */
+    bulkInTransfer.zlp = ((size % MAX_PACKET_SIZE_EP2) == 0);
+    
+    /* Fill both hardware buffers */
+    bulkInFill();
+    __set_PRIMASK(primask);
+    return true;
+}
+
+bool usbdevice::bulkOut(unsigned char *data, unsigned long size)
+{
+    /* Start receiving data from the host on EP2OUT. bulkOutComplete() is */
+    /* called when size bytes or a short packet have been received. */
+    uint32_t primask;
+    
+    /* As bulkIn() */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    
+    if (bulkOutTransfer.active)
+    {
+        __set_PRIMASK(primask);
+        return false;
+    }
+    
+    bulkOutTransfer.ptr = data;
+    bulkOutTransfer.remaining = size;
+    bulkOutTransfer.size = size;
+    bulkOutTransfer.active = true;
+    bulkOutTransfer.zlp = false;
+    
+    /* Collect any packets already waiting in the hardware buffers */
+    bulkOutDrain();
+    __set_PRIMASK(primask);
+    return true;
+}
+
+void usbdevice::bulkInFill(void)
+{
+    /* Keep both EP2IN buffers full while there is data left to send */
+    unsigned long packetSize;
+    
+    while ((bulkInTransfer.remaining > 0) || bulkInTransfer.zlp)
+    {
+        if (endpointBuffersFull(EP2IN) == 2)
+        {
+            /* Both buffers full; refilled from the next EP2IN event */
+            return;
+        }
+        
+        packetSize = bulkInTransfer.remaining;
+        
+        if (packetSize > MAX_PACKET_SIZE_EP2)
+        {
+            packetSize = MAX_PACKET_SIZE_EP2;
+        }
+        
+        if (packetSize < MAX_PACKET_SIZE_EP2)
+        {
+            /* This is the short (or zero length) packet ending the transfer */
+            bulkInTransfer.zlp = false;
+        }
+        
+        endpointWrite(EP2IN, bulkInTransfer.ptr, packetSize);
+        bulkInTransfer.ptr += packetSize;
+        bulkInTransfer.remaining -= packetSize;
+    }
+}
+
+void usbdevice::bulkOutDrain(void)
+{
+    /* Read packets from the EP2OUT buffers directly into the transfer */
+    unsigned long packetSize;
+    
+    while (bulkOutTransfer.active && (endpointBuffersFull(EP2OUT) > 0))
+    {
+        packetSize = endpointRead(EP2OUT, bulkOutTransfer.ptr, bulkOutTransfer.remaining);
+        
+        if (packetSize > bulkOutTransfer.remaining)
+        {
+            /* Data beyond the end of the transfer is discarded */
+            packetSize = bulkOutTransfer.remaining;
+        }
+        
+        bulkOutTransfer.ptr += packetSize;
+        bulkOutTransfer.remaining -= packetSize;
+        
+        if ((bulkOutTransfer.remaining == 0) || (packetSize < MAX_PACKET_SIZE_EP2))
+        {
+            /* Completed */
+            bulkOutTransfer.active = false;
+            bulkOutComplete(bulkOutTransfer.size - bulkOutTransfer.remaining);
+        }
+    }
+}
+
+void usbdevice::endpointEventEP2In(void)
+{
+    /* Endpoint 2 IN data event; one of the buffers has been sent */
+    if (!bulkInTransfer.active)
+    {
+        return;
+    }
+    
+    if ((bulkInTransfer.remaining == 0) && !bulkInTransfer.zlp)
+    {
+        /* Nothing left to queue; complete once both buffers have gone */
+        if (endpointBuffersFull(EP2IN) == 0)
+        {
+            bulkInTransfer.active = false;
+            bulkInComplete();
+        }
+        return;
+    }
+    
+    /* Refill the empty buffer while the other is on the wire */
+    bulkInFill();
+}
+
+void usbdevice::endpointEventEP2Out(void)
+{
+    /* Endpoint 2 OUT data event */
+    /* If no transfer is active the data stays in the buffers (host is NAKed) */
+    bulkOutDrain();
+}
+
+void usbdevice::bulkInComplete(void)
+{
+}
+
+void usbdevice::bulkOutComplete(unsigned long /* size */)
+{
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 /* Endpoint packet sizes */
 #define MAX_PACKET_SIZE_EP0 (64)
+#define MAX_PACKET_SIZE_EP2 (64)
 
 /* bmRequestType.dataTransferDirection */
 #define HOST_TO_DEVICE (0)
@@ -49,14 +50,45 @@ typedef struct {
     unsigned short wLength;
 } SETUP_PACKET;
 
+class usbdevice;
+
+/* Called when the OUT data stage of a control transfer has completed */
+typedef bool (usbdevice::*CONTROL_CALLBACK)(void);
+
 typedef struct {
     SETUP_PACKET  setup;
     unsigned char *ptr;
     unsigned long remaining;
     unsigned char direction;
     bool          zlp;
+    CONTROL_CALLBACK notify;
 } CONTROL_TRANSFER;
 
+typedef struct {
+    unsigned char *ptr;
+    unsigned long remaining;
+    unsigned long size;
+    bool          active;
+    bool          zlp;
+} BULK_TRANSFER;
+
+/* Control request timing, in microseconds */
+#define STANDARD_REQUESTS (12)
+
+typedef struct {
+    unsigned long count;
+    unsigned long totalTime;
+    unsigned long maxTime;
+} REQUEST_STATISTICS;
+
+typedef struct {
+    unsigned long resets;             /* Bus resets seen */
+    unsigned long resetToAddress;     /* Time from the last bus reset to SET_ADDRESS */
+    unsigned long resetToConfigured;  /* Time from the last bus reset to SET_CONFIGURATION */
+    REQUEST_STATISTICS standard[STANDARD_REQUESTS]; /* Indexed by bRequest */
+    REQUEST_STATISTICS other;         /* Class and vendor requests */
+} ENUMERATION_STATISTICS;
+
 typedef enum {ATTACHED, POWERED, DEFAULT, ADDRESS, CONFIGURED} DEVICE_STATE;
 
 typedef struct {
@@ -69,12 +101,13 @@ class usbdevice : public usbdc
 {
 public:
     usbdevice(); 
+    void getEnumerationStatistics(ENUMERATION_STATISTICS *statistics);
+    void resetEnumerationStatistics(void);
 protected:
     virtual void endpointEventEP0Setup(void);
     virtual void endpointEventEP0In(void);
     virtual void endpointEventEP0Out(void);
     virtual bool requestSetup(void);
-    virtual bool requestOut(void);
     virtual void deviceEventReset(void);
     virtual bool requestGetDescriptor(void);
             bool requestSetAddress(void);
@@ -85,12 +118,29 @@ protected:
     virtual bool requestGetInterface(void);
             bool requestSetFeature(void);
             bool requestClearFeature(void);    
+    virtual void endpointEventEP2In(void);
+    virtual void endpointEventEP2Out(void);
+    void realiseBulkEndpoints(void);
+    bool bulkIn(unsigned char *data, unsigned long size);
+    bool bulkOut(unsigned char *data, unsigned long size);
+    virtual void bulkInComplete(void);
+    virtual void bulkOutComplete(unsigned long size);
     CONTROL_TRANSFER transfer;
     USB_DEVICE device;
+    BULK_TRANSFER bulkInTransfer;
+    BULK_TRANSFER bulkOutTransfer;
+    ENUMERATION_STATISTICS enumerationStatistics;
+    unsigned long enumerationStart; /* us_ticker_read() at power up or the last bus reset */
 private:
+    unsigned char alternateSetting; /* GET_INTERFACE data stage */
+    unsigned short statusReply;     /* GET_STATUS data stage */
+    bool setupDecoded;              /* The last setup event held a valid setup packet */
+    void bulkInFill(void);
+    void bulkOutDrain(void);
     bool controlIn(void);
     bool controlOut(void);
     bool controlSetup(void);
+    void recordRequestTime(unsigned long time);
     void decodeSetupPacket(unsigned char *data, SETUP_PACKET *packet);
 };
 
@@ -3,24 +3,49 @@
 /* Copyright (c) Phil Wright 2008 */
 
 #include "mbed.h"
+#include "us_ticker_api.h"
 #include "usbhid.h"
 #include "asciihid.h"
 
-/* Endpoint packet sizes */
-#define MAX_PACKET_SIZE_EP1 (64)
-
 /* HID Class */
 #define HID_CLASS         (3)
 #define HID_SUBCLASS_NONE (0)
+#define HID_SUBCLASS_BOOT (1)
 #define HID_PROTOCOL_NONE (0)
+#define HID_PROTOCOL_KEYBOARD (1)
+#ifdef USB_BOOT_KEYBOARD
+#define HID_INTERFACE_SUBCLASS HID_SUBCLASS_BOOT
+#define HID_INTERFACE_PROTOCOL HID_PROTOCOL_KEYBOARD
+#else
+#define HID_INTERFACE_SUBCLASS HID_SUBCLASS_NONE
+#define HID_INTERFACE_PROTOCOL HID_PROTOCOL_NONE
+#endif
 #define HID_DESCRIPTOR    (33)
 #define REPORT_DESCRIPTOR (34)
 
 /* Class requests */
-#define GET_REPORT (0x1)
-#define GET_IDLE   (0x2)
-#define SET_REPORT (0x9)
-#define SET_IDLE   (0xa)
+#define GET_REPORT   (0x1)
+#define GET_IDLE     (0x2)
+#define GET_PROTOCOL (0x3)
+#define SET_REPORT   (0x9)
+#define SET_IDLE     (0xa)
+#define SET_PROTOCOL (0xb)
+
+/* Protocols */
+#define BOOT_PROTOCOL   (0)
+#define REPORT_PROTOCOL (1)
+
+/* Report types */
+#define REPORT_TYPE(wValue) (wValue >> 8)
+#define INPUT_REPORT   (1)
+#define OUTPUT_REPORT  (2)
+#define FEATURE_REPORT (3)
+
+/* Queued input taking turns once controls and button changes are sent */
+#define TURN_TOUCH (0)
+#define TURN_MOUSE (1)
+#define TURN_TEXT  (2)
+#define TURNS      (3)
     
 /* Descriptors */
 unsigned char deviceDescriptor[] = {
@@ -44,46 +69,6 @@ unsigned char deviceDescriptor[] = {
     0x01                     /* bNumConfigurations */
     };
     
-unsigned char configurationDescriptor[] = {
-    0x09,                        /* bLength */
-    CONFIGURATION_DESCRIPTOR,    /* bDescriptorType */
-    0x09+0x09+0x09+0x07,         /* wTotalLength (LSB) */
-    0x00,                        /* wTotalLength (MSB) */
-    0x01,                        /* bNumInterfaces */
-    0x01,                        /* bConfigurationValue */
-    0x00,                        /* iConfiguration */
-    0xc0,                        /* bmAttributes */
-    0x00,                        /* bMaxPower */
-    
-    0x09,                        /* bLength */
-    INTERFACE_DESCRIPTOR,        /* bDescriptorType */    
-    0x00,                        /* bInterfaceNumber */
-    0x00,                        /* bAlternateSetting */
-    0x01,                        /* bNumEndpoints */
-    HID_CLASS,                   /* bInterfaceClass */
-    HID_SUBCLASS_NONE,           /* bInterfaceSubClass */
-    HID_PROTOCOL_NONE,           /* bInterfaceProtocol */
-    0x00,                        /* iInterface */
-    
-    0x09,                        /* bLength */
-    HID_DESCRIPTOR,              /* bDescriptorType */
-    0x11,                        /* bcdHID (LSB) */
-    0x01,                        /* bcdHID (MSB) */
-    0x00,                        /* bCountryCode */
-    0x01,                        /* bNumDescriptors */
-    REPORT_DESCRIPTOR,           /* bDescriptorType */
-    0x79,                        /* wDescriptorLength (LSB) */
-    0x00,                        /* wDescriptorLength (MSB) */
-        
-    0x07,                        /* bLength */
-    ENDPOINT_DESCRIPTOR,         /* bDescriptorType */
-    0x81,                        /* bEndpointAddress */
-    0x03,                        /* bmAttributes */
-    MAX_PACKET_SIZE_EP1,         /* wMaxPacketSize (LSB) */
-    0x00,                        /* wMaxPacketSize (MSB) */
-    0x0a,                        /* bInterval */
-    };
-    
 /* HID Class Report Descriptor */
 /* Short items: size is 0, 1, 2 or 3 specifying 0, 1, 2 or 4 (four) bytes of data as per HID Class standard */
 
@@ -120,10 +105,69 @@ unsigned char configurationDescriptor[] = {
 #define STRING_MAX(size)        (0x98 | size)
 #define DELIMITER(size)         (0xa8 | size)
 
-#define REPORT_ID_KEYBOARD      (1)
-#define REPORT_ID_MOUSE         (2)
+/* A relative mouse; one collection per pointer */
+#define MOUSE_COLLECTION(id) \
+USAGE_PAGE(1),      0x01, \
+USAGE(1),           0x02, \
+COLLECTION(1),      0x01, \
+USAGE(1),           0x01, \
+COLLECTION(1),      0x00, \
+REPORT_ID(1),       id,   \
+REPORT_COUNT(1),    0x03, \
+REPORT_SIZE(1),     0x01, \
+USAGE_PAGE(1),      0x09, \
+USAGE_MIN(1),       0x1,  \
+USAGE_MAX(1),       0x3,  \
+LOGICAL_MIN(1),     0x00, \
+LOGICAL_MAX(1),     0x01, \
+INPUT(1),           0x02, \
+REPORT_COUNT(1),    0x01, \
+REPORT_SIZE(1),     0x05, \
+INPUT(1),           0x01, \
+REPORT_COUNT(1),    0x03, \
+REPORT_SIZE(1),     0x08, \
+USAGE_PAGE(1),      0x01, \
+USAGE(1),           0x30, \
+USAGE(1),           0x31, \
+USAGE(1),           0x38, \
+LOGICAL_MIN(1),     0x81, \
+LOGICAL_MAX(1),     0x7f, \
+INPUT(1),           0x06, \
+END_COLLECTION(0),        \
+END_COLLECTION(0),       
 
-#define MAX_REPORT_SIZE         (8)
+/* One finger of the touch screen; X and Y in mm (cm, exponent -1) */
+#define FINGER_COLLECTION \
+USAGE(1),           0x22,                                   \
+COLLECTION(1),      0x02,                                   \
+USAGE(1),           0x42,                                   \
+LOGICAL_MIN(1),     0x00,                                   \
+LOGICAL_MAX(1),     0x01,                                   \
+REPORT_SIZE(1),     0x01,                                   \
+REPORT_COUNT(1),    0x01,                                   \
+INPUT(1),           0x02,                                   \
+REPORT_COUNT(1),    0x07,                                   \
+INPUT(1),           0x03,                                   \
+USAGE(1),           0x51,                                   \
+LOGICAL_MAX(1),     0x7f,                                   \
+REPORT_SIZE(1),     0x08,                                   \
+REPORT_COUNT(1),    0x01,                                   \
+INPUT(1),           0x02,                                   \
+PUSH(0),                                                    \
+USAGE_PAGE(1),      0x01,                                   \
+LOGICAL_MAX(2),     TOUCH_MAX & 0xff, TOUCH_MAX >> 8,       \
+REPORT_SIZE(1),     0x10,                                   \
+UNIT(1),            0x11,                                   \
+UNIT_EXPONENT(1),   0x0f,                                   \
+PHYSICAL_MIN(1),    0x00,                                   \
+PHYSICAL_MAX(2),    TOUCH_WIDTH & 0xff, TOUCH_WIDTH >> 8,   \
+USAGE(1),           0x30,                                   \
+INPUT(1),           0x02,                                   \
+PHYSICAL_MAX(2),    TOUCH_HEIGHT & 0xff, TOUCH_HEIGHT >> 8, \
+USAGE(1),           0x31,                                   \
+INPUT(1),           0x02,                                   \
+POP(0),                                                     \
+END_COLLECTION(0),                                         
 
 unsigned char reportDescriptor[] = {
 /* Keyboard */
@@ -161,55 +205,240 @@ USAGE_MAX(2),       0xff, 0x00,
 INPUT(1),           0x00,
 END_COLLECTION(0),
 
-/* Mouse */
-USAGE_PAGE(1),      0x01, 
-USAGE(1),           0x02, 
-COLLECTION(1),      0x01, 
-USAGE(1),           0x01, 
-COLLECTION(1),      0x00, 
-REPORT_ID(1),       REPORT_ID_MOUSE,
-REPORT_COUNT(1),    0x03,
-REPORT_SIZE(1),     0x01,
-USAGE_PAGE(1),      0x09,
-USAGE_MIN(1),       0x1,
-USAGE_MAX(1),       0x3,
+/* Mice */
+MOUSE_COLLECTION(REPORT_ID_MOUSE)
+#if POINTERS > 1
+MOUSE_COLLECTION(REPORT_ID_POINTER(1))
+#endif
+#if POINTERS > 2
+MOUSE_COLLECTION(REPORT_ID_POINTER(2))
+#endif
+#if POINTERS > 3
+MOUSE_COLLECTION(REPORT_ID_POINTER(3))
+#endif
+
+/* N-key rollover keyboard; a bitmap of usages */
+USAGE_PAGE(1),      0x01,
+USAGE(1),           0x06,
+COLLECTION(1),      0x01,
+REPORT_ID(1),       REPORT_ID_NKRO,
+USAGE_PAGE(1),      0x07,
+USAGE_MIN(1),       0xE0,
+USAGE_MAX(1),       0xE7,
 LOGICAL_MIN(1),     0x00,
 LOGICAL_MAX(1),     0x01,
+REPORT_SIZE(1),     0x01,
+REPORT_COUNT(1),    0x08,
+INPUT(1),           0x02,
+USAGE_MIN(1),       0x00,
+USAGE_MAX(1),       NKRO_USAGES-1,
+REPORT_COUNT(1),    NKRO_USAGES,
 INPUT(1),           0x02,
+END_COLLECTION(0),
+
+/* Consumer control; one 16-bit usage, 0 when released */
+USAGE_PAGE(1),      0x0c,
+USAGE(1),           0x01,
+COLLECTION(1),      0x01,
+REPORT_ID(1),       REPORT_ID_CONSUMER,
+USAGE_MIN(1),       0x00,
+USAGE_MAX(2),       CONSUMER_MAX_USAGE & 0xff, CONSUMER_MAX_USAGE >> 8,
+LOGICAL_MIN(1),     0x00,
+LOGICAL_MAX(2),     CONSUMER_MAX_USAGE & 0xff, CONSUMER_MAX_USAGE >> 8,
+REPORT_SIZE(1),     0x10,
 REPORT_COUNT(1),    0x01,
-REPORT_SIZE(1),     0x05,
-INPUT(1),           0x01,
-REPORT_COUNT(1),    0x03,
-REPORT_SIZE(1),     0x08,
+INPUT(1),           0x00,
+END_COLLECTION(0),
+
+/* System control; 1 to 3 select power down, sleep and wake up, 0 when released */
 USAGE_PAGE(1),      0x01,
-USAGE(1),           0x30,
-USAGE(1),           0x31,
-USAGE(1),           0x38,
-LOGICAL_MIN(1),     0x81,
-LOGICAL_MAX(1),     0x7f,
-INPUT(1),           0x06,
+USAGE(1),           0x80,
+COLLECTION(1),      0x01,
+REPORT_ID(1),       REPORT_ID_SYSTEM,
+USAGE_MIN(1),       SYSTEM_POWER_DOWN,
+USAGE_MAX(1),       SYSTEM_WAKE,
+LOGICAL_MIN(1),     0x01,
+LOGICAL_MAX(1),     0x03,
+REPORT_SIZE(1),     0x08,
+REPORT_COUNT(1),    0x01,
+INPUT(1),           0x00,
+END_COLLECTION(0),
+
+#if TOUCH_CONTACTS > 0
+/* Touch screen; the fingers then how many are in the report */
+USAGE_PAGE(1),      0x0d,
+USAGE(1),           0x04,
+COLLECTION(1),      0x01,
+REPORT_ID(1),       REPORT_ID_TOUCH,
+FINGER_COLLECTION
+#if TOUCH_CONTACTS > 1
+FINGER_COLLECTION
+#endif
+#if TOUCH_CONTACTS > 2
+FINGER_COLLECTION
+#endif
+#if TOUCH_CONTACTS > 3
+FINGER_COLLECTION
+#endif
+#if TOUCH_CONTACTS > 4
+FINGER_COLLECTION
+#endif
+USAGE(1),           0x54,
+LOGICAL_MIN(1),     0x00,
+LOGICAL_MAX(1),     TOUCH_CONTACTS,
+REPORT_SIZE(1),     0x08,
+REPORT_COUNT(1),    0x01,
+INPUT(1),           0x02,
+REPORT_ID(1),       REPORT_ID_TOUCH_MAX,
+USAGE(1),           0x55,
+FEATURE(1),         0x02,
 END_COLLECTION(0),
+#endif
+
+/* Vendor defined link statistics */
+USAGE_PAGE(2),      0x00, 0xff,
+USAGE(1),           0x01,
+COLLECTION(1),      0x01,
+REPORT_ID(1),       REPORT_ID_STATISTICS,
+USAGE(1),           0x02,
+LOGICAL_MIN(1),     0x00,
+LOGICAL_MAX(2),     0xff, 0x00,
+REPORT_SIZE(1),     0x08,
+REPORT_COUNT(1),    STATISTICS_REPORT_SIZE,
+FEATURE(1),         0x02,
 END_COLLECTION(0),
 };
-    
-volatile bool complete;
-volatile bool configured;
-unsigned char outputReport[MAX_REPORT_SIZE];
 
+unsigned char configurationDescriptor[] = {
+    0x09,                        /* bLength */
+    CONFIGURATION_DESCRIPTOR,    /* bDescriptorType */
+    0x09+0x09+0x09+0x07,         /* wTotalLength (LSB) */
+    0x00,                        /* wTotalLength (MSB) */
+    0x01,                        /* bNumInterfaces */
+    0x01,                        /* bConfigurationValue */
+    0x00,                        /* iConfiguration */
+    0xc0,                        /* bmAttributes */
+    0x00,                        /* bMaxPower */
+    
+    0x09,                        /* bLength */
+    INTERFACE_DESCRIPTOR,        /* bDescriptorType */    
+    0x00,                        /* bInterfaceNumber */
+    0x00,                        /* bAlternateSetting */
+    0x01,                        /* bNumEndpoints */
+    HID_CLASS,                   /* bInterfaceClass */
+    HID_INTERFACE_SUBCLASS,      /* bInterfaceSubClass */
+    HID_INTERFACE_PROTOCOL,      /* bInterfaceProtocol */
+    0x00,                        /* iInterface */
+    
+    0x09,                        /* bLength */
+    HID_DESCRIPTOR,              /* bDescriptorType */
+    0x11,                        /* bcdHID (LSB) */
+    0x01,                        /* bcdHID (MSB) */
+    0x00,                        /* bCountryCode */
+    0x01,                        /* bNumDescriptors */
+    REPORT_DESCRIPTOR,           /* bDescriptorType */
+    sizeof(reportDescriptor) & 0xff,  /* wDescriptorLength (LSB) */
+    sizeof(reportDescriptor) >> 8,    /* wDescriptorLength (MSB) */
+        
+    0x07,                        /* bLength */
+    ENDPOINT_DESCRIPTOR,         /* bDescriptorType */
+    0x81,                        /* bEndpointAddress */
+    0x03,                        /* bmAttributes */
+    MAX_PACKET_SIZE_EP1,         /* wMaxPacketSize (LSB) */
+    0x00,                        /* wMaxPacketSize (MSB) */
+    EP1_INTERVAL,                /* bInterval */
+    };
+    
 usbhid::usbhid()
 {
     configured = false;
+    complete = false;
+    inputBusy = false;
+    blockingWaiters = 0;
+    resendPending = false;
+    reportDropped = false;
+    resetPolicy = INPUT_POLICY_KEEP;
+    expiryTime = 0;
+    droppedInputCount = 0;
+    inFlightCallback = NULL;
+    keyReport = 0;
+    keyReportCount = 0;
+    keyLifted = false;
+    keyStream = NULL;
+    memset(mouseButtons, 0, sizeof(mouseButtons));
+    mouseTurn = 0;
+    inputTurn = TURN_TOUCH;
+    controlRelease = 0;
+    layout = DEFAULT_KEYBOARD_LAYOUT;
+    memset(&keyState, 0, sizeof(keyState));
+    memset(nkroState, 0, sizeof(nkroState));
+    nkro = false;
+    ledState = 0;
+    bootProtocol = false;
+    inputReportCount = 0;
+    resetLatencyStatistics();
+#ifdef USB_BENCHMARK
+    cycleStatisticsReset(&submitCycles);
+    cycleStatisticsReset(&writeCycles);
+#endif
     connect();
 }
 
 void usbhid::deviceEventReset()
 {
-    configured = false;
+    holdInput();
+    
+    /* Hosts expect the report protocol after a reset */
+    bootProtocol = false;
     
     /* Must call base class */ 
     usbdevice::deviceEventReset();
 }
 
+void usbhid::holdInput(void)
+{
+    /* The device is no longer configured, after a bus reset or */
+    /* SET_CONFIGURATION(0). Input waits for restartInput() or is dropped, */
+    /* as the reset policy says. */
+    unsigned char i;
+    
+    configured = false;
+    
+    /* The report in flight is lost; send it again once configured unless */
+    /* the policy drops it. inputBusy stays set until then so nothing else */
+    /* takes the endpoint. */
+    if (inputBusy && !resendPending)
+    {
+        if (resetPolicy == INPUT_POLICY_DROP)
+        {
+            dropInFlight();
+        }
+        else
+        {
+            resendPending = true;
+        }
+    }
+    
+    if (resetPolicy == INPUT_POLICY_DROP)
+    {
+        /* Forget everything posted before the reset */
+        dropQueued(&controlQueue, false);
+        dropQueued(&touchQueue, false);
+        for (i=0; i<POINTERS; i++)
+        {
+            dropQueued(&mouseQueue[i], false);
+        }
+        dropQueued(&textQueue, false);
+        keyReport = 0;
+        keyReportCount = 0;
+        keyLifted = false;
+        controlRelease = 0;
+    }
+    
+    /* The host has forgotten the button state */
+    memset(mouseButtons, 0, sizeof(mouseButtons));
+}
+
 bool usbhid::requestSetConfiguration(void)
 {
     bool result;
@@ -221,15 +450,113 @@ bool usbhid::requestSetConfiguration(void)
     /* Must call base class */
     result = usbdevice::requestSetConfiguration();
     
-    if (result)
+    if (result && (transfer.setup.wValue != 0))
     {
-        /* Now configured */
+        /* Now configured; carry on with the input held over any reset */
         configured = true;
+        restartInput();
+    }
+    else if (result)
+    {
+        holdInput();
     }
     
     return result;
 }
 
+void usbhid::restartInput(void)
+{
+    /* Resume sending input as soon as the device is configured */
+    unsigned char i;
+    
+    if (resetPolicy == INPUT_POLICY_EXPIRE)
+    {
+        dropQueued(&controlQueue, true);
+        dropQueued(&touchQueue, true);
+        for (i=0; i<POINTERS; i++)
+        {
+            dropQueued(&mouseQueue[i], true);
+        }
+        dropQueued(&textQueue, true);
+    }
+    
+    if (resendPending)
+    {
+        resendPending = false;
+        
+        if ((resetPolicy == INPUT_POLICY_EXPIRE) && expired(inputReportTime))
+        {
+            dropInFlight();
+        }
+        else
+        {
+            /* inputReport still holds the report lost with the reset */
+            inputBusy = true;
+            endpointWrite(EP1IN, inputReport, inputReportSize+1);
+#ifdef USB_LATENCY_STATISTICS
+            reportFrame = getFrameNumber();
+#endif
+            return;
+        }
+    }
+    
+    sendQueuedReport();
+}
+
+bool usbhid::expired(unsigned long time)
+{
+    /* True if input stamped at time is older than the expiry time */
+    /* The microsecond ticker wraps modulo 2^32, so the difference is */
+    /* right for any age up to INPUT_EXPIRY_MAX */
+    return ((uint32_t)(us_ticker_read() - time) / 1000) > expiryTime;
+}
+
+void usbhid::dropInFlight(void)
+{
+    /* Give up on the report in flight; its callback is not called and a */
+    /* blocking sender returns false */
+    inputBusy = false;
+    inFlightCallback = NULL;
+    reportDropped = true;
+    droppedInputCount++;
+}
+
+void usbhid::dropQueued(usbqueue *queue, bool expiredOnly)
+{
+    /* Drop queued events, or only those that have expired. Events are */
+    /* queued in time order so only the oldest need checking. Callbacks */
+    /* of dropped events are not called. */
+    INPUT_EVENT event;
+    
+    while (queue->peek(&event) && (!expiredOnly || expired(event.time)))
+    {
+        queue->pop();
+        droppedInputCount++;
+    }
+}
+
+void usbhid::setResetPolicy(unsigned char policy, unsigned long expiry)
+{
+    /* Choose what happens to queued and in-flight input across a bus reset. */
+    /* expiry is the greatest age, in ms, kept with INPUT_POLICY_EXPIRE; */
+    /* at most INPUT_EXPIRY_MAX. */
+    if (expiry > INPUT_EXPIRY_MAX)
+    {
+        expiry = INPUT_EXPIRY_MAX;
+    }
+    
+    __disable_irq();
+    resetPolicy = policy;
+    expiryTime = expiry;
+    __enable_irq();
+}
+
+unsigned long usbhid::getDroppedInputCount(void)
+{
+    /* Events and reports dropped by the reset policy */
+    return droppedInputCount;
+}
+
 bool usbhid::requestGetDescriptor(void)
 {
     bool success = false;
@@ -281,14 +608,65 @@ bool usbhid::requestSetup(void)
     {
         switch (transfer.setup.bRequest)
         {
+             case GET_REPORT:
+                 if (REPORT_TYPE(transfer.setup.wValue) != FEATURE_REPORT)
+                 {
+                     break;
+                 }
+                 switch (transfer.setup.wValue & 0xff)
+                 {
+                    case REPORT_ID_STATISTICS:
+                        buildStatisticsReport();
+                        transfer.remaining = sizeof(featureReport);
+                        transfer.ptr = featureReport;
+                        transfer.direction = DEVICE_TO_HOST;
+                        success = true;
+                        break;
+#if TOUCH_CONTACTS > 0
+                    case REPORT_ID_TOUCH_MAX:
+                        /* Fingers the touch screen reports at once */
+                        featureReport[0] = REPORT_ID_TOUCH_MAX;
+                        featureReport[1] = TOUCH_CONTACTS;
+                        transfer.remaining = 2;
+                        transfer.ptr = featureReport;
+                        transfer.direction = DEVICE_TO_HOST;
+                        success = true;
+                        break;
+#endif
+                    default:
+                        break;
+                 }
+                 break;
+             case GET_PROTOCOL:
+                 protocolReply = bootProtocol ? BOOT_PROTOCOL : REPORT_PROTOCOL;
+                 transfer.remaining = 1;
+                 transfer.ptr = &protocolReply;
+                 transfer.direction = DEVICE_TO_HOST;
+                 success = true;
+                 break;
+             case SET_PROTOCOL:
+                 /* A BIOS selects the boot protocol; see writeInputReport() */
+                 bootProtocol = (transfer.setup.wValue == BOOT_PROTOCOL);
+                 success = true;
+                 break;
+             case SET_IDLE:
+                 /* Reports are only sent on change; accepted so boot hosts carry on */
+                 success = true;
+                 break;
              case SET_REPORT:
                  switch (transfer.setup.wValue & 0xff)
                  {
+                    case 0:                     /* Boot protocol LED report */
                     case REPORT_ID_KEYBOARD:                     
-                        /* TODO: LED state */
-                        transfer.remaining = sizeof(outputReport);
+                        /* LED state; the data stage is read straight into outputReport */
+                        if (transfer.setup.wLength > sizeof(outputReport))
+                        {
+                            break;
+                        }
+                        transfer.remaining = transfer.setup.wLength;
                         transfer.ptr = outputReport;
                         transfer.direction = HOST_TO_DEVICE;
+                        transfer.notify = static_cast<CONTROL_CALLBACK>(&usbhid::requestSetReportComplete);
                         success = true;    
                         break;
                     default:
@@ -309,93 +687,1434 @@ bool usbhid::requestSetup(void)
     return usbdevice::requestSetup();
 }
 
-bool usbhid::sendInputReport(unsigned char id, unsigned char *data, unsigned char size)
+bool usbhid::requestSetReportComplete(void)
 {
-    /* Send an Input Report */
-    /* If data is NULL an all zero report is sent */
+    /* Keyboard output report received; the first byte is the report ID, */
+    /* except in the boot protocol */
+    if ((transfer.setup.wValue & 0xff) == 0)
+    {
+        if (transfer.setup.wLength < 1)
+        {
+            return false;
+        }
+        ledState = outputReport[0];
+        return true;
+    }
+    
+    if ((transfer.setup.wLength < 2) || (outputReport[0] != REPORT_ID_KEYBOARD))
+    {
+        return false;
+    }
     
-    static unsigned char report[MAX_REPORT_SIZE+1]; /* +1 for report ID */
+    ledState = outputReport[1];
+    return true;
+}
+
+unsigned char usbhid::keyboardLEDs(void)
+{
+    /* Returns the keyboard LED state last set by the host */
+    return ledState;
+}
+
+void usbhid::buildStatisticsReport(void)
+{
+    /* Fill the link statistics feature report */
+    USB_ERROR_STATISTICS statistics;
+    unsigned long counters[STATISTICS_REPORT_SIZE/4];
+    unsigned char *p;
     unsigned char i;
+    
+    getErrorStatistics(&statistics);
+    counters[0] = statistics.pid;
+    counters[1] = statistics.crc;
+    counters[2] = statistics.timeout;
+    counters[3] = statistics.bitStuff;
+    counters[4] = statistics.sync;
+    counters[5] = statistics.overrun;
+    counters[6] = statistics.retries;
+    counters[7] = statistics.other;
+    counters[8] = statistics.naks;
+    
+    /* Add report ID */
+    featureReport[0] = REPORT_ID_STATISTICS;
+    
+    /* Add counters, least significant byte first */
+    p = &featureReport[1];
+    for (i=0; i<STATISTICS_REPORT_SIZE/4; i++)
+    {
+        *p++ = counters[i];
+        *p++ = counters[i] >> 8;
+        *p++ = counters[i] >> 16;
+        *p++ = counters[i] >> 24;
+    }
+}
+
+bool usbhid::sendInputReport(unsigned char id, const unsigned char *data, unsigned char size)
+{
+    /* Send an Input Report and wait until the host has collected it */
+    /* If data is NULL an all zero report is sent */
+    bool waiting;
+#ifdef USB_BENCHMARK
+    unsigned long start;
+#endif
 
     if (size > MAX_REPORT_SIZE)
     {
         return false;
     }
     
+    /* Block if not configured */
+    PROFILE_BEGIN(PROFILE_WAIT_CONFIGURED);
+    while (!configured)
+    {
+        idle();
+    }
+    PROFILE_END(PROFILE_WAIT_CONFIGURED);
+    
+    /* Wait for a queued report in flight to be collected; queued reports */
+    /* are held back while any sender is waiting so the senders go next. */
+    /* Senders in other interrupts may wait at the same time, so they are */
+    /* counted. configured is tested again with the endpoint claimed, as a */
+    /* bus reset may have come in since. */
+    waiting = false;
+    for (;;)
+    {
+        __disable_irq();
+        if (configured && !inputBusy)
+        {
+            break;
+        }
+        if (!waiting)
+        {
+            blockingWaiters++;
+            waiting = true;
+        }
+        __enable_irq();
+        idle();
+    }
+    if (waiting)
+    {
+        blockingWaiters--;
+    }
+    
+#ifdef USB_BENCHMARK
+    start = cycleCounterRead();
+#endif
+    
+    /* Send report */
+    complete = false;
+    reportDropped = false;
+    inputBusy = true;
+    writeInputReport(id, data, size);
+    __enable_irq();
+#ifdef USB_BENCHMARK
+    cycleStatisticsAdd(&submitCycles, cycleCounterRead() - start);
+#endif
+    
+    /* Wait for completion; a report lost with a bus reset is sent again */
+    /* once configured, unless the reset policy drops it */
+    PROFILE_BEGIN(PROFILE_WAIT_COMPLETE);
+    while(!complete && !reportDropped)
+    {
+        idle();
+    }
+    PROFILE_END(PROFILE_WAIT_COMPLETE);
+    return complete;
+}
+
+void usbhid::writeInputReport(unsigned char id, const unsigned char *data, unsigned char size)
+{
+    /* Build an input report and write it to the endpoint. The caller owns */
+    /* the endpoint (inputBusy) and must not be interrupted by EP1 events. */
+    /* If data is NULL an all zero report is sent */
+    unsigned char i;
+#ifdef USB_BENCHMARK
+    unsigned long start;
+#endif
+    
     /* Add report ID */
-    report[0]=id;
+    inputReport[0]=id;
 
     /* Add report data */
     if (data != NULL)
     {    
         for (i=0; i<size; i++)
         {
-            report[i+1] = *data++;
+            inputReport[i+1] = *data++;
         }
     }
     else
     {    
         for (i=0; i<size; i++)
         {
-            report[i+1] = 0;
+            inputReport[i+1] = 0;
         }
     }    
     
-    /* Block if not configured */
-    while (!configured);
-    
-    /* Send report */
-    complete = false;
-    disableEvents();
-    endpointWrite(EP1IN, report, size+1); /* +1 for report ID */
-    enableEvents();
-    
-    /* Wait for completion */
-    while(!complete && configured);    
-    return true;
+#ifdef USB_BENCHMARK
+    start = cycleCounterRead();
+#endif
+    if (bootProtocol)
+    {
+        /* The host only reads 8 byte keyboard reports without a report ID. */
+        /* Any other report is replaced by the held keys, which the host */
+        /* sees as no change; inputReport is kept for a resend after reset. */
+        memcpy(bootReport, (id == REPORT_ID_KEYBOARD) ? &inputReport[1] : keyState.data, 8);
+        endpointWrite(EP1IN, bootReport, 8);
+    }
+    else
+    {
+        endpointWrite(EP1IN, inputReport, size+1); /* +1 for report ID */
+    }
+#ifdef USB_BENCHMARK
+    cycleStatisticsAdd(&writeCycles, cycleCounterRead() - start);
+#endif
+#ifdef USB_LATENCY_STATISTICS
+    reportFrame = getFrameNumber();
+#endif
+    inputReportSize = size;
+    inputReportTime = us_ticker_read();
+    inputReportCount++;
 }
-    
-void usbhid::endpointEventEP1In(void)
+
+unsigned long usbhid::getInputReportCount(void)
+{
+    /* Number of input reports sent; use with getSIEStatistics() to find the SIE cost per report */
+    return inputReportCount;
+}
+    
+void usbhid::endpointEventEP1In(void)
 {
+#ifdef USB_LATENCY_STATISTICS
+    /* Frames elapsed since the report was written; frame numbers wrap at 2048 */
+    unsigned long frames = (getFrameNumber() - reportFrame) & 0x7ff;
+    
+    latencyStatistics.reports++;
+    latencyStatistics.totalFrames += frames;
+    latencyStatistics.totalSquaredFrames += frames * frames;
+    
+    if (frames < latencyStatistics.minFrames)
+    {
+        latencyStatistics.minFrames = frames;
+    }
+    
+    if (frames > latencyStatistics.maxFrames)
+    {
+        latencyStatistics.maxFrames = frames;
+    }
+    
+    if (frames > EP1_INTERVAL)
+    {
+        latencyStatistics.late++;
+    }
+#endif
+    INPUT_CALLBACK callback = inFlightCallback;
+    
+    /* Collected, so nothing to resend even if a reset is also pending */
     complete = true;
+    inputBusy = false;
+    resendPending = false;
+    inFlightCallback = NULL;
+    
+    if (callback != NULL)
+    {
+        /* The report carrying a queued event has been collected */
+        callback(inFlightContext);
+    }
+    
+    /* Send the next queued report, if any */
+    sendQueuedReport();
+}
+
+void usbhid::getLatencyStatistics(LATENCY_STATISTICS *statistics)
+{
+    /* Copy the input report latency statistics */
+    *statistics = latencyStatistics;
+}
+
+void usbhid::resetLatencyStatistics(void)
+{
+    /* Clear the input report latency statistics */
+    latencyStatistics.reports = 0;
+    latencyStatistics.totalFrames = 0;
+    latencyStatistics.totalSquaredFrames = 0;
+    latencyStatistics.minFrames = 0xffffffff;
+    latencyStatistics.maxFrames = 0;
+    latencyStatistics.late = 0;
+}
+
+bool usbhid::setKeyboardLayout(const char *name)
+{
+    /* Select the host keyboard layout by name, e.g. "US", "UK", "DE" or "FR". */
+    /* Returns false, leaving the layout unchanged, if name is not known. */
+    const KEYBOARD_LAYOUT *found = findKeyboardLayout(name);
+    
+    if (found == NULL)
+    {
+        return false;
+    }
+    
+    layout = found;
+    return true;
+}
+
+const char *usbhid::getKeyboardLayout(void)
+{
+    return layout->name;
 }
 
 bool usbhid::keyboard(char c)
 {
     /* Send a simulated keyboard keypress. Returns true if successful. */    
-    unsigned char report[8]={0,0,0,0,0,0,0,0};
-
-    report[0] = keymap[c].modifier;
-    report[2] = keymap[c].usage;
+    /* Bytes from 0x80 are taken as ISO 8859-1. */
+    return keyboardUnicode((unsigned char)c);
+}
 
-    /* Key down */
-    if (!sendInputReport(REPORT_ID_KEYBOARD, report, 8))
+bool usbhid::keyboardUnicode(unsigned short code)
+{
+    /* Type one character, using a dead key first if the layout needs one. */
+    /* Keys held with press() stay held. Returns false if the layout can't */
+    /* type code or sending failed. */
+    unsigned char report[MAX_REPORT_SIZE];
+    unsigned char size;
+    KEYMAP strokes[MAX_KEYSTROKES];
+    unsigned char count;
+    unsigned char i;
+    
+    count = keyboardLookup(layout, code, strokes);
+    if (count == 0)
     {
         return false;
     }
+    
+    for (i=0; i<count; i++)
+    {
+        if (keyHeld(strokes[i].usage))
+        {
+            /* Held with press(); let it go so the key down is seen */
+            size = buildLiftReport(strokes[i].usage, report);
+            if (!sendInputReport(keyReportID(), report, size))
+            {
+                return false;
+            }
+        }
+        
+        /* Key down */
+        size = buildKeyReport(&strokes[i], report);
+        if (size == 0)
+        {
+            /* Too many keys held */
+            return false;
+        }
+        if (!sendInputReport(keyReportID(), report, size))
+        {
+            return false;
+        }
+
+        /* Key up */
+        size = buildKeyReport(NULL, report);
+        if (!sendInputReport(keyReportID(), report, size))
+        {
+            return false;
+        }    
+    }
+
+    return true;
+}
 
-    /* Key up */
-    if (!sendInputReport(REPORT_ID_KEYBOARD, NULL, 8))
+bool usbhid::keyboardRun(const char **string)
+{
+    /* Type the longest run of characters at *string that fits one N-key */
+    /* rollover press report, and advance past it. Hosts report the keys */
+    /* of one report in ascending usage order, so a run only takes keys of */
+    /* strictly ascending usage with the same modifiers. */
+    unsigned char report[NKRO_REPORT_SIZE];
+    KEYMAP strokes[MAX_KEYSTROKES];
+    const char *next = *string;
+    unsigned char modifier;
+    unsigned char last;
+    
+    if ((keyboardLookup(layout, decodeUTF8(&next), strokes) != 1)
+        || (strokes[0].usage >= NKRO_USAGES)
+        || keyHeld(strokes[0].usage))
+    {
+        /* Dead key sequence, held key or not typeable; type it alone */
+        return keyboardUnicode(decodeUTF8(string));
+    }
+    
+    buildKeyReport(&strokes[0], report);
+    modifier = strokes[0].modifier;
+    last = strokes[0].usage;
+    *string = next;
+    
+    while (**string != '\0')
+    {
+        if ((keyboardLookup(layout, decodeUTF8(&next), strokes) != 1)
+            || (strokes[0].modifier != modifier)
+            || (strokes[0].usage <= last)
+            || (strokes[0].usage >= NKRO_USAGES)
+            || (NKRO_HELD(nkroState, strokes[0].usage)))
+        {
+            break;
+        }
+        
+        report[1 + strokes[0].usage/8] |= 1 << (strokes[0].usage & 7);
+        last = strokes[0].usage;
+        *string = next;
+    }
+    
+    /* Keys down */
+    if (!sendInputReport(REPORT_ID_NKRO, report, NKRO_REPORT_SIZE))
     {
         return false;
-    }    
+    }
+    
+    /* Keys up */
+    return sendInputReport(REPORT_ID_NKRO, nkroState, NKRO_REPORT_SIZE);
+}
+
+bool usbhid::keyboardReports(const KEY_REPORT *reports, unsigned long count)
+{
+    /* Send prebuilt key press reports (see keyreports.h), each followed by */
+    /* a release back to the keys held with press(). The press reports are */
+    /* sent as built, without the held keys, except with N-key rollover where */
+    /* they are added to the held keys. Returns true if successful. */
+    unsigned char report[MAX_REPORT_SIZE];
+    unsigned char size;
+    unsigned long i;
+    
+    for (i=0; i<count; i++)
+    {
+        /* Key down */
+        size = buildPressReport(&reports[i], report);
+        if (!sendInputReport(keyReportID(), report, size))
+        {
+            return false;
+        }
+
+        /* Key up */
+        size = buildKeyReport(NULL, report);
+        if (!sendInputReport(keyReportID(), report, size))
+        {
+            return false;
+        }    
+    }
 
     return true;
 }
 
+unsigned char usbhid::buildKeyReport(const KEYMAP *stroke, unsigned char *report)
+{
+    /* A keyboard report of the held keys with stroke added, or of just the */
+    /* held keys if stroke is NULL. The report is for the current mode; */
+    /* returns its size, or 0 if stroke does not fit. */
+    unsigned char i;
+    
+    if (keyReportID() == REPORT_ID_NKRO)
+    {
+        memcpy(report, nkroState, NKRO_REPORT_SIZE);
+        if (stroke != NULL)
+        {
+            if (stroke->usage >= NKRO_USAGES)
+            {
+                return 0;
+            }
+            report[0] |= stroke->modifier;
+            report[1 + stroke->usage/8] |= 1 << (stroke->usage & 7);
+        }
+        return NKRO_REPORT_SIZE;
+    }
+    
+    memcpy(report, keyState.data, 8);
+    
+    if (stroke != NULL)
+    {
+        report[0] |= stroke->modifier;
+        for (i=2; i<2+KEYBOARD_ROLLOVER; i++)
+        {
+            if ((report[i] == 0) || (report[i] == stroke->usage))
+            {
+                report[i] = stroke->usage;
+                break;
+            }
+        }
+        
+        if (i == 2+KEYBOARD_ROLLOVER)
+        {
+            /* KEYBOARD_ROLLOVER other keys are held */
+            return 0;
+        }
+    }
+    return 8;
+}
+
+unsigned char usbhid::buildLiftReport(unsigned char usage, unsigned char *report)
+{
+    /* A keyboard report of the held keys without usage, in the current */
+    /* mode; returns its size */
+    unsigned char i;
+    
+    if (keyReportID() == REPORT_ID_NKRO)
+    {
+        memcpy(report, nkroState, NKRO_REPORT_SIZE);
+        report[1 + usage/8] &= ~(1 << (usage & 7));
+        return NKRO_REPORT_SIZE;
+    }
+    
+    memcpy(report, keyState.data, 8);
+    
+    for (i=2; i<2+KEYBOARD_ROLLOVER; i++)
+    {
+        if (report[i] == usage)
+        {
+            for (; i<1+KEYBOARD_ROLLOVER; i++)
+            {
+                report[i] = report[i+1];
+            }
+            report[1+KEYBOARD_ROLLOVER] = 0;
+            break;
+        }
+    }
+    return 8;
+}
+
+unsigned char usbhid::buildRolloverReport(unsigned char *report)
+{
+    /* A report telling the host a key could not be added to the held keys; */
+    /* every key slot is ErrorRollOver. Returns its size. */
+    unsigned char i;
+    
+    if (keyReportID() == REPORT_ID_NKRO)
+    {
+        /* Only usages beyond the bitmap don't fit; nothing changes */
+        memcpy(report, nkroState, NKRO_REPORT_SIZE);
+        return NKRO_REPORT_SIZE;
+    }
+    
+    memcpy(report, keyState.data, 8);
+    for (i=2; i<2+KEYBOARD_ROLLOVER; i++)
+    {
+        report[i] = KEY_ERROR_ROLLOVER;
+    }
+    return 8;
+}
+
+bool usbhid::keyHeld(unsigned char usage)
+{
+    /* True if usage is held with press() */
+    return (usage < NKRO_USAGES) && NKRO_HELD(nkroState, usage);
+}
+
+unsigned char usbhid::buildPressReport(const KEY_REPORT *press, unsigned char *report)
+{
+    /* A keyboard report for a prebuilt 6-key rollover press report, in the */
+    /* current mode; returns its size */
+    unsigned char i;
+    
+    if (keyReportID() == REPORT_ID_NKRO)
+    {
+        memcpy(report, nkroState, NKRO_REPORT_SIZE);
+        report[0] |= press->data[0];
+        for (i=2; i<2+KEYBOARD_ROLLOVER; i++)
+        {
+            if ((press->data[i] != 0) && (press->data[i] < NKRO_USAGES))
+            {
+                report[1 + press->data[i]/8] |= 1 << (press->data[i] & 7);
+            }
+        }
+        return NKRO_REPORT_SIZE;
+    }
+    
+    memcpy(report, press->data, 8);
+    return 8;
+}
+
+unsigned char usbhid::keyReportID(void)
+{
+    /* The boot protocol only has the 6-key rollover report */
+    return (nkro && !bootProtocol) ? REPORT_ID_NKRO : REPORT_ID_KEYBOARD;
+}
+
+bool usbhid::sendKeyState(void)
+{
+    /* Report the held keys */
+    if (keyReportID() == REPORT_ID_NKRO)
+    {
+        return sendInputReport(REPORT_ID_NKRO, nkroState, NKRO_REPORT_SIZE);
+    }
+    
+    return sendInputReport(REPORT_ID_KEYBOARD, keyState.data, 8);
+}
+
+bool usbhid::setNKRO(bool enable)
+{
+    /* Select N-key rollover reports (REPORT_ID_NKRO) or the default 6-key */
+    /* rollover reports (REPORT_ID_KEYBOARD). Held keys are released first. */
+    if (enable == nkro)
+    {
+        return true;
+    }
+    
+    if (!releaseAll())
+    {
+        return false;
+    }
+    
+    nkro = enable;
+    return true;
+}
+
+bool usbhid::press(unsigned char usage)
+{
+    /* Press and hold a key; modifier usages (KEY_LEFT_CTRL...) set their */
+    /* bit. A report is only sent if the state changes. Returns false if */
+    /* KEYBOARD_ROLLOVER keys are already held without N-key rollover, or */
+    /* sending failed. */
+    /* The key state is also read by the USB interrupt for queued text, */
+    /* so it is changed with interrupts disabled. */
+    unsigned char mask;
+    unsigned char i;
+    uint32_t primask;
+    
+    if ((usage >= KEY_LEFT_CTRL) && (usage <= KEY_RIGHT_GUI))
+    {
+        mask = 1 << (usage - KEY_LEFT_CTRL);
+        if (keyState.data[0] & mask)
+        {
+            return true;
+        }
+        primask = __get_PRIMASK();
+        __disable_irq();
+        keyState.data[0] |= mask;
+        nkroState[0] |= mask;
+        __set_PRIMASK(primask);
+        return sendKeyState();
+    }
+    
+    if (usage >= NKRO_USAGES)
+    {
+        return false;
+    }
+    
+    if (NKRO_HELD(nkroState, usage))
+    {
+        /* Already held */
+        return true;
+    }
+    
+    primask = __get_PRIMASK();
+    __disable_irq();
+    
+    for (i=2; i<2+KEYBOARD_ROLLOVER; i++)
+    {
+        if (keyState.data[i] == 0)
+        {
+            keyState.data[i] = usage;
+            break;
+        }
+    }
+    
+    if ((i == 2+KEYBOARD_ROLLOVER) && !nkro)
+    {
+        __set_PRIMASK(primask);
+        return false;
+    }
+    
+    nkroState[1 + usage/8] |= 1 << (usage & 7);
+    __set_PRIMASK(primask);
+    return sendKeyState();
+}
+
+bool usbhid::release(unsigned char usage)
+{
+    /* Release a held key. A report is only sent if the state changes. */
+    unsigned char mask;
+    unsigned char i;
+    uint32_t primask;
+    
+    if ((usage >= KEY_LEFT_CTRL) && (usage <= KEY_RIGHT_GUI))
+    {
+        mask = 1 << (usage - KEY_LEFT_CTRL);
+        if ((keyState.data[0] & mask) == 0)
+        {
+            return true;
+        }
+        primask = __get_PRIMASK();
+        __disable_irq();
+        keyState.data[0] &= ~mask;
+        nkroState[0] &= ~mask;
+        __set_PRIMASK(primask);
+        return sendKeyState();
+    }
+    
+    if ((usage >= NKRO_USAGES) || !NKRO_HELD(nkroState, usage))
+    {
+        return true;
+    }
+    
+    primask = __get_PRIMASK();
+    __disable_irq();
+    
+    nkroState[1 + usage/8] &= ~(1 << (usage & 7));
+    
+    for (i=2; i<2+KEYBOARD_ROLLOVER; i++)
+    {
+        if (keyState.data[i] == usage)
+        {
+            /* Close the gap so the order of the remaining keys is kept */
+            for (; i<1+KEYBOARD_ROLLOVER; i++)
+            {
+                keyState.data[i] = keyState.data[i+1];
+            }
+            keyState.data[1+KEYBOARD_ROLLOVER] = 0;
+            break;
+        }
+    }
+    
+    __set_PRIMASK(primask);
+    return sendKeyState();
+}
+
+bool usbhid::modifiers(unsigned char modifiers)
+{
+    /* Set all modifier bits (MODIFIER_LEFT_CTRL...) at once. A report is only */
+    /* sent if the state changes. */
+    uint32_t primask;
+    
+    if (keyState.data[0] == modifiers)
+    {
+        return true;
+    }
+    
+    primask = __get_PRIMASK();
+    __disable_irq();
+    keyState.data[0] = modifiers;
+    nkroState[0] = modifiers;
+    __set_PRIMASK(primask);
+    return sendKeyState();
+}
+
+bool usbhid::releaseAll(void)
+{
+    /* Release every held key and modifier */
+    static const unsigned char none[NKRO_REPORT_SIZE] = {0};
+    uint32_t primask;
+    
+    if (memcmp(nkroState, none, NKRO_REPORT_SIZE) == 0)
+    {
+        return true;
+    }
+    
+    primask = __get_PRIMASK();
+    __disable_irq();
+    memset(&keyState, 0, sizeof(keyState));
+    memset(nkroState, 0, sizeof(nkroState));
+    __set_PRIMASK(primask);
+    return sendKeyState();
+}
+
 bool usbhid::keyboard(char *string)
 {
-    /* Send a string of characters. Returns true if successful. */
-    do {
-        if (!keyboard(*string++))
+    /* Send a UTF-8 string. With N-key rollover, runs of characters are */
+    /* pressed together where the host keeps their order. Returns true if */
+    /* successful. */
+    const char *next = string;
+    
+    while (*next != '\0')
+    {
+        if (keyReportID() == REPORT_ID_NKRO)
+        {
+            if (!keyboardRun(&next))
+            {
+                return false;
+            }
+        }
+        else if (!keyboardUnicode(decodeUTF8(&next)))
         {
             return false;
         }
-    } while (*string != '\0');
+    }
 
     return true;
 }
 
+bool usbhid::postMouse(signed char x, signed char y, unsigned char buttons, signed char wheel,
+                       INPUT_CALLBACK callback, void *context)
+{
+    /* Queue a mouse event without blocking; may be called from any thread. */
+    /* callback (optional) is called once the host has collected the report */
+    /* carrying the event. Returns false if the queue is full. */
+    return postPointer(0, x, y, buttons, wheel, callback, context);
+}
+
+bool usbhid::postPointer(unsigned char pointer, signed char x, signed char y, unsigned char buttons,
+                         signed char wheel, INPUT_CALLBACK callback, void *context)
+{
+    /* As postMouse(), for one of POINTERS independent mice; pointer 0 is */
+    /* the mouse. Returns false if pointer is out of range or its queue is */
+    /* full. */
+    INPUT_EVENT event;
+    
+    if (pointer >= POINTERS)
+    {
+        return false;
+    }
+    
+    event.callback = callback;
+    event.context = context;
+    event.type = INPUT_MOUSE;
+    event.reports = NULL;
+    event.contacts = NULL;
+    event.buttons = buttons;
+    event.code = 0;
+    event.x = x;
+    event.y = y;
+    event.wheel = wheel;
+    event.time = us_ticker_read();
+    
+    if (!mouseQueue[pointer].push(&event))
+    {
+        return false;
+    }
+    
+    requestService();
+    return true;
+}
+
+bool usbhid::postKeyboard(char c, INPUT_CALLBACK callback, void *context)
+{
+    /* As postUnicode(); bytes from 0x80 are taken as ISO 8859-1 */
+    return postUnicode((unsigned char)c, callback, context);
+}
+
+bool usbhid::postUnicode(unsigned short code, INPUT_CALLBACK callback, void *context)
+{
+    /* Queue a character to type without blocking; may be called from any */
+    /* thread. callback (optional) is called once the host has collected the */
+    /* last key release, or straight away if the layout can't type code. */
+    /* Returns false if the queue is full. */
+    INPUT_EVENT event;
+    
+    event.callback = callback;
+    event.context = context;
+    event.reports = NULL;
+    event.contacts = NULL;
+    event.type = INPUT_KEYBOARD;
+    event.buttons = 0;
+    event.code = code;
+    event.x = 0;
+    event.y = 0;
+    event.wheel = 0;
+    event.time = us_ticker_read();
+    
+    if (!textQueue.push(&event))
+    {
+        return false;
+    }
+    
+    requestService();
+    return true;
+}
+
+bool usbhid::postKeyReports(const KEY_REPORT *reports, unsigned long count, INPUT_CALLBACK callback, void *context)
+{
+    /* Queue prebuilt key press reports (see keyreports.h) without blocking. */
+    /* Each press is followed by a release. callback (optional) is called */
+    /* once the last release has been collected. Returns false if the queue */
+    /* is full or count is more than MAX_QUEUED_KEY_REPORTS. */
+    INPUT_EVENT event;
+    
+    if (count > MAX_QUEUED_KEY_REPORTS)
+    {
+        return false;
+    }
+    
+    event.callback = callback;
+    event.context = context;
+    event.reports = reports;
+    event.contacts = NULL;
+    event.type = INPUT_REPORTS;
+    event.buttons = 0;
+    event.code = count;
+    event.x = 0;
+    event.y = 0;
+    event.wheel = 0;
+    event.time = us_ticker_read();
+    
+    if (!textQueue.push(&event))
+    {
+        return false;
+    }
+    
+    requestService();
+    return true;
+}
+
+bool usbhid::postControl(unsigned char type, unsigned short usage, INPUT_CALLBACK callback, void *context)
+{
+    /* Queue a consumer or system control press and release */
+    INPUT_EVENT event;
+    
+    event.callback = callback;
+    event.context = context;
+    event.reports = NULL;
+    event.contacts = NULL;
+    event.type = type;
+    event.buttons = 0;
+    event.code = usage;
+    event.x = 0;
+    event.y = 0;
+    event.wheel = 0;
+    event.time = us_ticker_read();
+    
+    if (!controlQueue.push(&event))
+    {
+        return false;
+    }
+    
+    requestService();
+    return true;
+}
+
+unsigned char usbhid::buildTouchReport(const TOUCH_CONTACT *contacts, unsigned char count, unsigned char *report)
+{
+    /* Build a touch screen report of count fingers; the rest are left */
+    /* empty. Returns the report size. */
+    unsigned short x, y;
+    unsigned char i;
+    
+    memset(report, 0, TOUCH_REPORT_SIZE);
+    
+    for (i=0; i<count; i++)
+    {
+        x = (contacts[i].x > TOUCH_MAX) ? TOUCH_MAX : contacts[i].x;
+        y = (contacts[i].y > TOUCH_MAX) ? TOUCH_MAX : contacts[i].y;
+        
+        report[i*6 + 0] = contacts[i].tip ? 1 : 0;
+        report[i*6 + 1] = contacts[i].id & 0x7f;
+        report[i*6 + 2] = x & 0xff;
+        report[i*6 + 3] = x >> 8;
+        report[i*6 + 4] = y & 0xff;
+        report[i*6 + 5] = y >> 8;
+    }
+    
+    report[TOUCH_CONTACTS*6] = count;
+    return TOUCH_REPORT_SIZE;
+}
+
+bool usbhid::touch(const TOUCH_CONTACT *contacts, unsigned char count)
+{
+    /* Send one touch screen frame of up to TOUCH_CONTACTS fingers and wait */
+    /* until the host has collected it. A pinch or two finger scroll is a */
+    /* frame per step with every finger in it. Returns false if the device */
+    /* has no touch screen or count is too large. */
+    unsigned char report[MAX_REPORT_SIZE];
+    
+    if ((TOUCH_CONTACTS == 0) || (count > TOUCH_CONTACTS))
+    {
+        return false;
+    }
+    
+    buildTouchReport(contacts, count, report);
+    return sendInputReport(REPORT_ID_TOUCH, report, TOUCH_REPORT_SIZE);
+}
+
+bool usbhid::postTouch(const TOUCH_CONTACT *contacts, unsigned char count, INPUT_CALLBACK callback, void *context)
+{
+    /* Queue a touch screen frame without blocking. contacts is read when */
+    /* the report is built, so it must be left unchanged until callback is */
+    /* called; use a buffer per frame to queue several. Frames take turns */
+    /* with mouse motion and text. Returns false as touch() or if the */
+    /* queue is full. */
+    INPUT_EVENT event;
+    
+    if ((TOUCH_CONTACTS == 0) || (count > TOUCH_CONTACTS))
+    {
+        return false;
+    }
+    
+    event.callback = callback;
+    event.context = context;
+    event.reports = NULL;
+    event.contacts = contacts;
+    event.type = INPUT_TOUCH;
+    event.buttons = 0;
+    event.code = count;
+    event.x = 0;
+    event.y = 0;
+    event.wheel = 0;
+    event.time = us_ticker_read();
+    
+    if (!touchQueue.push(&event))
+    {
+        return false;
+    }
+    
+    requestService();
+    return true;
+}
+
+bool usbhid::consumer(unsigned short usage, INPUT_CALLBACK callback, void *context)
+{
+    /* Queue a press and release of a consumer control (CONSUMER_VOLUME_UP...) */
+    /* without blocking; may be called from any thread. callback (optional) */
+    /* is called once the release has been collected. Returns false if the */
+    /* queue is full or usage is out of range. */
+    if ((usage == 0) || (usage > CONSUMER_MAX_USAGE))
+    {
+        return false;
+    }
+    
+    return postControl(INPUT_CONSUMER, usage, callback, context);
+}
+
+bool usbhid::systemControl(unsigned char usage, INPUT_CALLBACK callback, void *context)
+{
+    /* As consumer(), for SYSTEM_POWER_DOWN, SYSTEM_SLEEP or SYSTEM_WAKE */
+    if ((usage < SYSTEM_POWER_DOWN) || (usage > SYSTEM_WAKE))
+    {
+        return false;
+    }
+    
+    return postControl(INPUT_SYSTEM, usage, callback, context);
+}
+
+bool usbhid::volume(int steps)
+{
+    /* Step the volume up (steps > 0) or down (steps < 0) */
+    unsigned short usage = (steps > 0) ? CONSUMER_VOLUME_UP : CONSUMER_VOLUME_DOWN;
+    
+    if (steps < 0)
+    {
+        steps = -steps;
+    }
+    
+    while (steps-- > 0)
+    {
+        if (!consumer(usage))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool usbhid::mute(void)
+{
+    return consumer(CONSUMER_MUTE);
+}
+
+bool usbhid::playPause(void)
+{
+    return consumer(CONSUMER_PLAY_PAUSE);
+}
+
+bool usbhid::nextTrack(void)
+{
+    return consumer(CONSUMER_NEXT_TRACK);
+}
+
+bool usbhid::previousTrack(void)
+{
+    return consumer(CONSUMER_PREVIOUS_TRACK);
+}
+
+bool usbhid::stopPlayback(void)
+{
+    return consumer(CONSUMER_STOP);
+}
+
+bool usbhid::launch(unsigned short application)
+{
+    /* Application launch key (CONSUMER_LAUNCH_BROWSER...) */
+    return consumer(application);
+}
+
+bool usbhid::systemSleep(void)
+{
+    return systemControl(SYSTEM_SLEEP);
+}
+
+bool usbhid::systemWake(void)
+{
+    /* Only has an effect where the host wakes on input from this device */
+    return systemControl(SYSTEM_WAKE);
+}
+
+bool usbhid::typeAsync(const char *string, INPUT_CALLBACK callback, void *context)
+{
+    /* Queue a UTF-8 string without blocking. callback (optional) is called */
+    /* once the last character has been collected by the host. Returns false */
+    /* if the queue filled up, in which case callback is not called and only */
+    /* the start of the string is typed. */
+    unsigned short code;
+    
+    while (*string != '\0')
+    {
+        code = decodeUTF8(&string);
+        if (*string == '\0')
+        {
+            return postUnicode(code, callback, context);
+        }
+        
+        if (!postUnicode(code))
+        {
+            return false;
+        }
+    }
+    
+    /* Empty string; nothing to wait for */
+    if (callback != NULL)
+    {
+        callback(context);
+    }
+    return true;
+}
+
+static bool fitsReport(int value)
+{
+    /* True if a merged delta still fits a signed 8-bit report field */
+    return (value >= -128) && (value <= 127);
+}
+
+void usbhid::sendKeyStroke(void)
+{
+    /* Send the next report of the queued character or prebuilt reports */
+    /* being typed; a press then a release for each keystroke */
+    unsigned char report[MAX_REPORT_SIZE];
+    unsigned long stroke = keyReport / 2;
+    bool down = ((keyReport & 1) == 0);
+    unsigned char size;
+    
+    if ((keyStream != NULL) && down)
+    {
+        /* Prebuilt 6-key rollover press report */
+        size = buildPressReport(&keyStream[stroke], report);
+    }
+    else if (down && !keyLifted && keyHeld(keyStrokes[stroke].usage))
+    {
+        /* Held with press(); let it go first so the key down is seen */
+        size = buildLiftReport(keyStrokes[stroke].usage, report);
+        keyLifted = true;
+        inputBusy = true;
+        writeInputReport(keyReportID(), report, size);
+        return;
+    }
+    else
+    {
+        size = buildKeyReport(down ? &keyStrokes[stroke] : NULL, report);
+        if (size == 0)
+        {
+            /* Too many keys held to type this one */
+            size = buildRolloverReport(report);
+            droppedInputCount++;
+        }
+    }
+    
+    keyLifted = false;
+    keyReport++;
+    if (keyReport == keyReportCount)
+    {
+        inFlightCallback = releaseCallback;
+        inFlightContext = releaseContext;
+    }
+    
+    inputBusy = true;
+    writeInputReport(keyReportID(), report, size);
+}
+
+void usbhid::deviceEventService(void)
+{
+    /* Producers only queue events and ask for this; the queues are */
+    /* consumed in the USB interrupt (or poll()) alone */
+    sendQueuedReport();
+}
+
+unsigned long usbhid::processInput(void)
+{
+    /* Start sending queued events if the endpoint is idle; never blocks. */
+    /* Queued events are normally sent from the USB interrupt, so this is */
+    /* only an explicit kick for the application, e.g. after configuration. */
+    /* Returns the number of events taken from the queue. */
+    unsigned long events;
+    uint32_t primask = __get_PRIMASK(); /* May be called from an interrupt */
+    
+    __disable_irq();
+    events = sendQueuedReport();
+    __set_PRIMASK(primask);
+    
+    return events;
+}
+
+unsigned long usbhid::sendQueuedReport(void)
+{
+    /* Start the next queued report if the endpoint is free. This is the only */
+    /* consumer of the queues; it runs from the USB interrupt (EP1 IN */
+    /* completion or deviceEventService()), or with interrupts disabled. */
+    /* Blocking senders waiting for the endpoint go first, then consumer and */
+    /* system controls, then mouse button changes, then the rest of a key */
+    /* stroke already begun. Touch frames, mouse motion and text take turns */
+    /* while more than one is waiting, so none waits behind another for long. */
+    /* Returns the number of events taken. */
+    INPUT_EVENT event;
+    unsigned long events = 0;
+    unsigned char pointer;
+    unsigned char turn;
+    unsigned char i;
+    
+    if (!configured || inputBusy || (blockingWaiters != 0))
+    {
+        return 0;
+    }
+    
+    if (controlRelease != 0)
+    {
+        /* Release the consumer or system control pressed last */
+        inputBusy = true;
+        inFlightCallback = releaseCallback;
+        inFlightContext = releaseContext;
+        writeInputReport(controlRelease, NULL, (controlRelease == REPORT_ID_CONSUMER) ? 2 : 1);
+        controlRelease = 0;
+        return 0;
+    }
+    
+    if (controlQueue.peek(&event))
+    {
+        return sendControlReport();
+    }
+    
+    pointer = nextMousePointer(true);
+    if (pointer != POINTERS)
+    {
+        return sendMouseReport(pointer);
+    }
+    
+    if (keyReport < keyReportCount)
+    {
+        /* Key transitions go ahead of motion, so a key down is not left */
+        /* held (and auto-repeating) behind a stream of other reports */
+        sendKeyStroke();
+        return 0;
+    }
+    
+    for (i=0; i<TURNS; i++)
+    {
+        turn = (inputTurn + i) % TURNS;
+        
+        switch (turn)
+        {
+            case TURN_TOUCH:
+                if (touchQueue.peek(&event))
+                {
+                    events += sendTouchReport();
+                }
+                break;
+            case TURN_MOUSE:
+                pointer = nextMousePointer(false);
+                if (pointer != POINTERS)
+                {
+                    events += sendMouseReport(pointer);
+                }
+                break;
+            default:
+                /* May send nothing if nothing could be typed */
+                events += sendTextReport();
+                break;
+        }
+        
+        if (inputBusy)
+        {
+            /* The others go before this one next time */
+            inputTurn = (turn + 1) % TURNS;
+            break;
+        }
+    }
+    return events;
+}
+
+unsigned char usbhid::nextMousePointer(bool changesOnly)
+{
+    /* The pointer whose turn it is to send, taking only those with a */
+    /* button change waiting if changesOnly. Returns POINTERS if none. */
+    INPUT_EVENT event;
+    unsigned char pointer;
+    unsigned char i;
+    
+    for (i=0; i<POINTERS; i++)
+    {
+        pointer = (mouseTurn + i) % POINTERS;
+        
+        if (mouseQueue[pointer].peek(&event)
+            && (!changesOnly || (event.buttons != mouseButtons[pointer])))
+        {
+            return pointer;
+        }
+    }
+    return POINTERS;
+}
+
+unsigned long usbhid::sendControlReport(void)
+{
+    /* Press the next queued consumer or system control; the callback */
+    /* waits for the release */
+    INPUT_EVENT event;
+    unsigned char report[2];
+    unsigned char size;
+    
+    controlQueue.peek(&event);
+    controlQueue.pop();
+    
+    if (event.type == INPUT_CONSUMER)
+    {
+        controlRelease = REPORT_ID_CONSUMER;
+        report[0] = event.code & 0xff;
+        report[1] = event.code >> 8;
+        size = 2;
+    }
+    else
+    {
+        controlRelease = REPORT_ID_SYSTEM;
+        report[0] = event.code - SYSTEM_POWER_DOWN + 1;
+        size = 1;
+    }
+    
+    releaseCallback = event.callback;
+    releaseContext = event.context;
+    inputBusy = true;
+    writeInputReport(controlRelease, report, size);
+    return 1;
+}
+
+unsigned long usbhid::sendTouchReport(void)
+{
+    /* Send the next queued touch screen frame */
+    INPUT_EVENT event;
+    unsigned char report[MAX_REPORT_SIZE];
+    unsigned char size;
+    
+    touchQueue.peek(&event);
+    touchQueue.pop();
+    
+    size = buildTouchReport(event.contacts, event.code, report);
+    inputBusy = true;
+    inFlightCallback = event.callback;
+    inFlightContext = event.context;
+    writeInputReport(REPORT_ID_TOUCH, report, size);
+    return 1;
+}
+
+unsigned long usbhid::sendMouseReport(unsigned char pointer)
+{
+    /* Send the next queued report of a mouse. Motion with the buttons unchanged */
+    /* is merged by summing deltas. A button change is always a report of */
+    /* its own, so motion queued before it is reported under the old button */
+    /* state and a drag keeps its path. An event with a callback also ends */
+    /* the report so it is reported on time. */
+    INPUT_EVENT event;
+    INPUT_EVENT next;
+    unsigned char report[4];
+    unsigned long events = 1;
+    int x, y, wheel;
+    
+    usbqueue *queue = &mouseQueue[pointer];
+    
+    queue->peek(&event);
+    queue->pop();
+    
+    x = event.x;
+    y = event.y;
+    wheel = event.wheel;
+    
+    while ((event.callback == NULL)
+           && (event.buttons == mouseButtons[pointer])
+           && queue->peek(&next)
+           && (next.buttons == event.buttons)
+           && fitsReport(x + next.x)
+           && fitsReport(y + next.y)
+           && fitsReport(wheel + next.wheel))
+    {
+        queue->pop();
+        events++;
+        x += next.x;
+        y += next.y;
+        wheel += next.wheel;
+        event.callback = next.callback;
+        event.context = next.context;
+    }
+    
+    report[0] = event.buttons;
+    report[1] = x;
+    report[2] = y;
+    report[3] = wheel;
+    mouseButtons[pointer] = event.buttons;
+    
+    /* Pointers take turns */
+    mouseTurn = (pointer + 1) % POINTERS;
+    
+    inputBusy = true;
+    inFlightCallback = event.callback;
+    inFlightContext = event.context;
+    writeInputReport(REPORT_ID_POINTER(pointer), report, 4);
+    return events;
+}
+
+unsigned long usbhid::sendTextReport(void)
+{
+    /* Send the next report of the queued text; returns the number of */
+    /* events taken, which may be 0 if nothing could be sent */
+    INPUT_EVENT event;
+    unsigned long events = 0;
+    
+    if (keyReport < keyReportCount)
+    {
+        /* Continue typing the last queued character */
+        sendKeyStroke();
+        return 0;
+    }
+    
+    while (textQueue.peek(&event))
+    {
+        textQueue.pop();
+        events++;
+        
+        if (event.type == INPUT_KEYBOARD)
+        {
+            keyStream = NULL;
+            keyReportCount = 2 * keyboardLookup(layout, event.code, keyStrokes);
+        }
+        else
+        {
+            keyStream = event.reports;
+            keyReportCount = 2 * (unsigned long)event.code;
+        }
+        
+        if (keyReportCount != 0)
+        {
+            /* The callback waits for the last key up */
+            keyReport = 0;
+            keyLifted = false;
+            releaseCallback = event.callback;
+            releaseContext = event.context;
+            sendKeyStroke();
+            return events;
+        }
+        
+        /* Nothing to type, or the layout can't type this character; skip it */
+        if (event.callback != NULL)
+        {
+            event.callback(event.context);
+            
+            if (inputBusy)
+            {
+                /* The callback queued and started a report */
+                return events;
+            }
+        }
+    }
+    
+    return events;
+}
+
 bool usbhid::mouse(signed char x, signed char y, unsigned char buttons, signed char wheel)
 {
     /* Send a simulated mouse event. Returns true if successful. */    
@@ -411,5 +2130,6 @@ bool usbhid::mouse(signed char x, signed char y, unsigned char buttons, signed c
         return false;
     }    
 
+    mouseButtons[0] = buttons;
     return true;
 }
@@ -6,27 +6,278 @@
 #define USBHID_H
 
 #include "usbdevice.h"
+#include "usbqueue.h"
+#include "asciihid.h"
 
 /* Mouse buttons */
 #define MOUSE_L (1<<0)
 #define MOUSE_M (1<<1)
 #define MOUSE_R (1<<2)
 
+/* Keyboard LEDs */
+#define KEYBOARD_NUM_LOCK    (1<<0)
+#define KEYBOARD_CAPS_LOCK   (1<<1)
+#define KEYBOARD_SCROLL_LOCK (1<<2)
+#define KEYBOARD_COMPOSE     (1<<3)
+#define KEYBOARD_KANA        (1<<4)
+
+/* Keyboard modifier usages, for press() and release() */
+#define KEY_LEFT_CTRL   (0xe0)
+#define KEY_LEFT_SHIFT  (0xe1)
+#define KEY_LEFT_ALT    (0xe2)
+#define KEY_LEFT_GUI    (0xe3)
+#define KEY_RIGHT_CTRL  (0xe4)
+#define KEY_RIGHT_SHIFT (0xe5)
+#define KEY_RIGHT_ALT   (0xe6)
+#define KEY_RIGHT_GUI   (0xe7)
+
+/* Keyboard report usage for more keys held than the report can carry */
+#define KEY_ERROR_ROLLOVER (0x01)
+
+/* Keyboard modifier bits, for modifiers() */
+#define MODIFIER_LEFT_CTRL   (1<<0)
+#define MODIFIER_LEFT_SHIFT  (1<<1)
+#define MODIFIER_LEFT_ALT    (1<<2)
+#define MODIFIER_LEFT_GUI    (1<<3)
+#define MODIFIER_RIGHT_CTRL  (1<<4)
+#define MODIFIER_RIGHT_SHIFT (1<<5)
+#define MODIFIER_RIGHT_ALT   (1<<6)
+#define MODIFIER_RIGHT_GUI   (1<<7)
+
+/* Consumer page (0x0c) usages, for consumer() */
+#define CONSUMER_NEXT_TRACK     (0xb5)
+#define CONSUMER_PREVIOUS_TRACK (0xb6)
+#define CONSUMER_STOP           (0xb7)
+#define CONSUMER_PLAY_PAUSE     (0xcd)
+#define CONSUMER_MUTE           (0xe2)
+#define CONSUMER_VOLUME_UP      (0xe9)
+#define CONSUMER_VOLUME_DOWN    (0xea)
+#define CONSUMER_LAUNCH_MEDIA   (0x183)
+#define CONSUMER_LAUNCH_EMAIL   (0x18a)
+#define CONSUMER_LAUNCH_CALCULATOR (0x192)
+#define CONSUMER_LAUNCH_FILES   (0x194)
+#define CONSUMER_LAUNCH_BROWSER (0x196)
+#define CONSUMER_MAX_USAGE      (0x3ff)
+
+/* Generic desktop system control usages, for systemControl() */
+#define SYSTEM_POWER_DOWN (0x81)
+#define SYSTEM_SLEEP      (0x82)
+#define SYSTEM_WAKE       (0x83)
+
+/* Touch screen fingers per report; 0 for no touch screen, otherwise 1 to 5 */
+#ifndef TOUCH_CONTACTS
+#define TOUCH_CONTACTS          (0)
+#endif
+#if (TOUCH_CONTACTS < 0) || (TOUCH_CONTACTS > 5)
+#error TOUCH_CONTACTS must be 0 to 5
+#endif
+
+/* Touch screen coordinates and physical size (mm) */
+#define TOUCH_MAX               (0x7fff)
+#ifndef TOUCH_WIDTH
+#define TOUCH_WIDTH             (200)
+#endif
+#ifndef TOUCH_HEIGHT
+#define TOUCH_HEIGHT            (150)
+#endif
+
+/* Most prebuilt key reports queued by one postKeyReports(); the count is */
+/* carried in a 16-bit event field */
+#define MAX_QUEUED_KEY_REPORTS  (0xffff)
+
+/* Keys held at once in the keyboard report */
+#define KEYBOARD_ROLLOVER (6)
+
+/* Endpoint packet sizes */
+#define MAX_PACKET_SIZE_EP1     (64)
+
+/* Report IDs */
+#define REPORT_ID_KEYBOARD      (1)
+#define REPORT_ID_MOUSE         (2)
+#define REPORT_ID_STATISTICS    (3)
+#define REPORT_ID_NKRO          (4)
+#define REPORT_ID_CONSUMER      (5)
+#define REPORT_ID_SYSTEM        (6)
+
+/* Independent relative pointers; pointer 0 is the mouse, the others */
+/* follow the fixed report IDs */
+#ifndef POINTERS
+#define POINTERS                (1)
+#endif
+#if (POINTERS < 1) || (POINTERS > 4)
+#error POINTERS must be 1 to 4
+#endif
+#define REPORT_ID_POINTER(n)    ((n) == 0 ? REPORT_ID_MOUSE : REPORT_ID_SYSTEM + (n))
+#define REPORT_ID_TOUCH         (10)
+#define REPORT_ID_TOUCH_MAX     (11)    /* Contact count maximum feature report */
+
+/* Declare the interface a boot keyboard, so a BIOS can type with it. The */
+/* boot protocol carries only the keyboard; while a host uses it the */
+/* mouse, pointers, touch screen and controls send nothing useful. */
+/* #define USB_BOOT_KEYBOARD */
+
+/* N-key rollover report; modifiers then one bit per usage below NKRO_USAGES */
+#define NKRO_USAGES             (0xe0)
+#define NKRO_REPORT_SIZE        (1 + NKRO_USAGES/8)
+#define NKRO_HELD(report, usage) (((report)[1 + (usage)/8] >> ((usage) & 7)) & 1)
+
+/* Touch screen report; tip switch, contact ID, X and Y per finger, then */
+/* the number of fingers in the report */
+#define TOUCH_REPORT_SIZE       (TOUCH_CONTACTS*6 + 1)
+
+#define MAX_REPORT_SIZE         ((TOUCH_REPORT_SIZE > NKRO_REPORT_SIZE) ? TOUCH_REPORT_SIZE : NKRO_REPORT_SIZE)
+
+/* Link statistics feature report; nine little endian 32-bit counters */
+#define STATISTICS_REPORT_SIZE  (9*4)
+
+/* What happens to queued and in-flight input across a bus reset */
+#define INPUT_POLICY_KEEP   (0)  /* Everything is sent once configured again */
+#define INPUT_POLICY_DROP   (1)  /* Everything posted before the reset is dropped */
+#define INPUT_POLICY_EXPIRE (2)  /* Input older than the expiry time is dropped */
+
+/* Longest expiry time (ms); input is stamped with the 32-bit microsecond ticker */
+#define INPUT_EXPIRY_MAX    (0xffffffffUL / 1000)
+
+/* Interrupt IN endpoint polling interval (frames) */
+#define EP1_INTERVAL            (10)
+
+/* Input report latency, in 1ms frames, from endpointWrite until the host */
+/* has collected the report. Only gathered when built with USB_LATENCY_STATISTICS */
+typedef struct {
+    unsigned long reports;
+    unsigned long totalFrames;
+    unsigned long totalSquaredFrames; /* For the variance (jitter) */
+    unsigned long minFrames;
+    unsigned long maxFrames;
+    unsigned long late;               /* Reports waiting longer than EP1_INTERVAL */
+} LATENCY_STATISTICS;
+
 class usbhid : public usbdevice
 {
 public:
     usbhid();
     bool keyboard(char c);
     bool keyboard(char *string);
+    bool keyboardUnicode(unsigned short code);
+    bool keyboardReports(const KEY_REPORT *reports, unsigned long count);
+    bool press(unsigned char usage);
+    bool release(unsigned char usage);
+    bool modifiers(unsigned char modifiers);
+    bool releaseAll(void);
+    bool setNKRO(bool enable);
+    bool setKeyboardLayout(const char *name);
+    const char *getKeyboardLayout(void);
     bool mouse(signed char x, signed char y, unsigned char buttons=0, signed char wheel=0);
+    unsigned long getInputReportCount(void);
+    unsigned char keyboardLEDs(void);
+    void getLatencyStatistics(LATENCY_STATISTICS *statistics);
+    void resetLatencyStatistics(void);
+    bool postMouse(signed char x, signed char y, unsigned char buttons=0, signed char wheel=0,
+                   INPUT_CALLBACK callback=NULL, void *context=NULL);
+    bool postPointer(unsigned char pointer, signed char x, signed char y, unsigned char buttons=0,
+                     signed char wheel=0, INPUT_CALLBACK callback=NULL, void *context=NULL);
+    bool touch(const TOUCH_CONTACT *contacts, unsigned char count);
+    bool postTouch(const TOUCH_CONTACT *contacts, unsigned char count,
+                   INPUT_CALLBACK callback=NULL, void *context=NULL);
+    bool postKeyboard(char c, INPUT_CALLBACK callback=NULL, void *context=NULL);
+    bool postUnicode(unsigned short code, INPUT_CALLBACK callback=NULL, void *context=NULL);
+    bool postKeyReports(const KEY_REPORT *reports, unsigned long count,
+                        INPUT_CALLBACK callback=NULL, void *context=NULL);
+    bool consumer(unsigned short usage, INPUT_CALLBACK callback=NULL, void *context=NULL);
+    bool systemControl(unsigned char usage, INPUT_CALLBACK callback=NULL, void *context=NULL);
+    bool volume(int steps);
+    bool mute(void);
+    bool playPause(void);
+    bool nextTrack(void);
+    bool previousTrack(void);
+    bool stopPlayback(void);
+    bool launch(unsigned short application);
+    bool systemSleep(void);
+    bool systemWake(void);
+    bool typeAsync(const char *string, INPUT_CALLBACK callback=NULL, void *context=NULL);
+    unsigned long processInput(void);
+    void setResetPolicy(unsigned char policy, unsigned long expiry=0);
+    unsigned long getDroppedInputCount(void);
 protected:
+    volatile bool complete;
+    volatile bool configured;
+#ifdef USB_BENCHMARK
+    CYCLE_STATISTICS submitCycles; /* sendInputReport() up to, not including, the wait for the host */
+    CYCLE_STATISTICS writeCycles;  /* endpointWrite() of an input report */
+#endif
+    bool sendInputReport(unsigned char id, const unsigned char *data, unsigned char size);
     virtual bool requestSetConfiguration();
     virtual void endpointEventEP1In(void);
     virtual void deviceEventReset(void);
+    virtual void deviceEventService(void);
     virtual bool requestGetDescriptor(void);
     virtual bool requestSetup(void);
 private:
-    bool sendInputReport(unsigned char id, unsigned char *data, unsigned char size);
+    void writeInputReport(unsigned char id, const unsigned char *data, unsigned char size);
+    unsigned long sendQueuedReport(void);
+    unsigned long sendControlReport(void);
+    unsigned long sendTouchReport(void);
+    unsigned long sendMouseReport(unsigned char pointer);
+    unsigned char nextMousePointer(bool changesOnly);
+    unsigned long sendTextReport(void);
+    void holdInput(void);
+    void restartInput(void);
+    bool expired(unsigned long time);
+    void dropInFlight(void);
+    void dropQueued(usbqueue *queue, bool expiredOnly);
+    void sendKeyStroke(void);
+    bool postControl(unsigned char type, unsigned short usage, INPUT_CALLBACK callback, void *context);
+    unsigned char buildTouchReport(const TOUCH_CONTACT *contacts, unsigned char count, unsigned char *report);
+    unsigned char buildKeyReport(const KEYMAP *stroke, unsigned char *report);
+    unsigned char buildPressReport(const KEY_REPORT *press, unsigned char *report);
+    unsigned char buildLiftReport(unsigned char usage, unsigned char *report);
+    unsigned char buildRolloverReport(unsigned char *report);
+    bool keyHeld(unsigned char usage);
+    unsigned char keyReportID(void);
+    bool sendKeyState(void);
+    bool keyboardRun(const char **string);
+    void buildStatisticsReport(void);
+    bool requestSetReportComplete(void);
+    unsigned long inputReportCount;
+    usbqueue controlQueue;               /* Consumer and system controls; sent first */
+    usbqueue mouseQueue[POINTERS];       /* Button changes, then motion */
+    usbqueue touchQueue;                 /* Touch screen frames */
+    usbqueue textQueue;                  /* Characters and prebuilt key reports; sent last */
+    volatile bool inputBusy;             /* A report is waiting to be collected */
+    volatile unsigned char blockingWaiters; /* sendInputReport() calls waiting for the endpoint */
+    bool resendPending;                  /* inputReport was lost with a bus reset */
+    volatile bool reportDropped;         /* The report in flight was dropped by the policy */
+    unsigned char resetPolicy;           /* INPUT_POLICY_KEEP... */
+    unsigned long expiryTime;            /* ms, for INPUT_POLICY_EXPIRE */
+    unsigned long droppedInputCount;
+    unsigned char inputReportSize;       /* Of inputReport, without the report ID */
+    unsigned long inputReportTime;       /* When inputReport was first written, in us */
+    unsigned char mouseButtons[POINTERS]; /* Button state last reported */
+    unsigned char mouseTurn;             /* Pointer to try first */
+    unsigned char inputTurn;             /* TURN_TOUCH, TURN_MOUSE or TURN_TEXT goes first next */
+    INPUT_CALLBACK inFlightCallback;     /* Called when the report in flight is collected */
+    void *inFlightContext;
+    KEYMAP keyStrokes[MAX_KEYSTROKES];   /* Keystrokes of the queued character being typed */
+    const KEY_REPORT *keyStream;         /* Or prebuilt press reports; NULL if none */
+    unsigned long keyReport;             /* Next press or release */
+    unsigned long keyReportCount;        /* A press and a release per keystroke */
+    bool keyLifted;                      /* The held key of the next press has been let go */
+    unsigned char controlRelease;        /* Consumer or system report ID to release next; 0 if none */
+    INPUT_CALLBACK releaseCallback;      /* Moves to inFlightCallback with the last release */
+    void *releaseContext;
+    const KEYBOARD_LAYOUT *layout;
+    KEY_REPORT keyState;                 /* Keys held with press() */
+    unsigned char nkroState[NKRO_REPORT_SIZE]; /* The same, as an N-key rollover report */
+    bool nkro;                           /* Keyboard reports use REPORT_ID_NKRO */
+    volatile bool bootProtocol;          /* Set by the host with SET_PROTOCOL */
+    unsigned char protocolReply;         /* GET_PROTOCOL data stage */
+    unsigned char bootReport[8];         /* Boot protocol keyboard report; no report ID */
+    LATENCY_STATISTICS latencyStatistics;
+    unsigned short reportFrame;
+    volatile unsigned char ledState;
+    unsigned char inputReport[MAX_REPORT_SIZE+1];           /* +1 for report ID */
+    unsigned char outputReport[MAX_REPORT_SIZE];
+    unsigned char featureReport[STATISTICS_REPORT_SIZE+1];  /* +1 for report ID */
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,250 @@
+/* usbpcap.cpp */
+/* Capture of USB transactions in pcap format (Linux usbmon link type) */
+
+#include "mbed.h"
+#include "usbpcap.h"
+
+/* pcap file header */
+#define PCAP_MAGIC         (0xa1b2c3d4)
+#define PCAP_VERSION_MAJOR (2)
+#define PCAP_VERSION_MINOR (4)
+#define PCAP_SNAPLEN       (0xffff)
+#define LINKTYPE_USB_LINUX (189)
+
+/* pcap record header and usbmon packet header sizes */
+#define PCAP_RECORD_HEADER_SIZE (16)
+#define USBMON_HEADER_SIZE      (48)
+
+/* usbmon flags and status */
+#define USBMON_SETUP_PRESENT (0)
+#define USBMON_NO_SETUP      ('-')
+#define USBMON_DATA_PRESENT  (0)
+#define USBMON_NO_DATA       ('<')
+#define USBMON_EINPROGRESS   (-115)
+
+/* USB bus number reported to the analyser */
+#define USBMON_BUS (1)
+
+static unsigned char *put16(unsigned char *p, unsigned long value)
+{
+    *p++ = value;
+    *p++ = value >> 8;
+    return p;
+}
+
+static unsigned char *put32(unsigned char *p, unsigned long value)
+{
+    p = put16(p, value);
+    return put16(p, value >> 16);
+}
+
+usbpcap::usbpcap()
+{
+    file = NULL;
+    head = 0;
+    tail = 0;
+    id = 0;
+    droppedPackets = 0;
+    seconds = 0;
+    microseconds = 0;
+    lastTime = 0;
+}
+
+bool usbpcap::open(const char *path)
+{
+    /* Create the capture file and write the pcap file header */
+    unsigned char header[24];
+    unsigned char *p = header;
+    
+    file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    
+    p = put32(p, PCAP_MAGIC);
+    p = put16(p, PCAP_VERSION_MAJOR);
+    p = put16(p, PCAP_VERSION_MINOR);
+    p = put32(p, 0);                   /* thiszone */
+    p = put32(p, 0);                   /* sigfigs */
+    p = put32(p, PCAP_SNAPLEN);
+    p = put32(p, LINKTYPE_USB_LINUX);
+    fwrite(header, 1, sizeof(header), file);
+    
+    timer.reset();
+    timer.start();
+    return true;
+}
+
+void usbpcap::close(void)
+{
+    /* Write any buffered packets and close the file */
+    if (file != NULL)
+    {
+        flush();
+        fclose(file);
+        file = NULL;
+    }
+}
+
+unsigned long usbpcap::dropped(void)
+{
+    /* Packets lost because the buffer was full */
+    return droppedPackets;
+}
+
+void usbpcap::flush(void)
+{
+    /* Write buffered packets to the file. Call from thread context; */
+    /* packets are added from the USB interrupt */
+    unsigned long end;
+    
+    if (file == NULL)
+    {
+        return;
+    }
+    
+    __disable_irq();
+    end = head;
+    __enable_irq();
+    
+    while (tail != end)
+    {
+        fputc(buffer[tail % PCAP_BUFFER_SIZE], file);
+        tail++;
+    }
+    
+    fflush(file);
+}
+
+void usbpcap::timestamp(unsigned long *sec, unsigned long *usec)
+{
+    /* Time since open(); the Timer is read as a 32-bit wrapping count */
+    unsigned long now = timer.read_us();
+    
+    microseconds += now - lastTime;
+    lastTime = now;
+    
+    seconds += microseconds / 1000000;
+    microseconds %= 1000000;
+    
+    *sec = seconds;
+    *usec = microseconds;
+}
+
+void usbpcap::put(unsigned char *header, unsigned char *data, unsigned long length)
+{
+    /* Copy a record into the buffer if there is room for all of it */
+    unsigned long size = PCAP_RECORD_HEADER_SIZE + USBMON_HEADER_SIZE + length;
+    unsigned long i;
+    
+    if ((PCAP_BUFFER_SIZE - (head - tail)) < size)
+    {
+        droppedPackets++;
+        return;
+    }
+    
+    for (i=0; i<PCAP_RECORD_HEADER_SIZE + USBMON_HEADER_SIZE; i++)
+    {
+        buffer[head % PCAP_BUFFER_SIZE] = header[i];
+        head++;
+    }
+    
+    for (i=0; i<length; i++)
+    {
+        buffer[head % PCAP_BUFFER_SIZE] = data[i];
+        head++;
+    }
+}
+
+void usbpcap::setup(unsigned char address, unsigned char *packet)
+{
+    /* Record a SETUP transaction as a control submission carrying the setup packet */
+    unsigned char header[PCAP_RECORD_HEADER_SIZE + USBMON_HEADER_SIZE];
+    unsigned long sec, usec;
+    unsigned char *p = header;
+    unsigned char i;
+    
+    if (file == NULL)
+    {
+        return;
+    }
+    
+    timestamp(&sec, &usec);
+    
+    /* pcap record header */
+    p = put32(p, sec);
+    p = put32(p, usec);
+    p = put32(p, USBMON_HEADER_SIZE);
+    p = put32(p, USBMON_HEADER_SIZE);
+    
+    /* usbmon header */
+    p = put32(p, id++);
+    p = put32(p, 0);
+    *p++ = PCAP_SUBMIT;
+    *p++ = PCAP_CONTROL;
+    *p++ = (packet[0] & 0x80);         /* Direction of the data stage */
+    *p++ = address;
+    p = put16(p, USBMON_BUS);
+    *p++ = USBMON_SETUP_PRESENT;
+    *p++ = USBMON_NO_DATA;
+    p = put32(p, sec);
+    p = put32(p, 0);
+    p = put32(p, usec);
+    p = put32(p, USBMON_EINPROGRESS);
+    p = put32(p, packet[6] | (packet[7] << 8)); /* wLength */
+    p = put32(p, 0);
+    for (i=0; i<8; i++)
+    {
+        *p++ = packet[i];
+    }
+    
+    put(header, NULL, 0);
+}
+
+void usbpcap::packet(unsigned char type, unsigned char transferType, unsigned char endpoint, 
+                     unsigned char address, unsigned char *data, unsigned long length)
+{
+    /* Record an IN or OUT data transaction. endpoint is the USB endpoint */
+    /* address (bit 7 set for IN). */
+    unsigned char header[PCAP_RECORD_HEADER_SIZE + USBMON_HEADER_SIZE];
+    unsigned long sec, usec;
+    unsigned char *p = header;
+    unsigned char i;
+    
+    if (file == NULL)
+    {
+        return;
+    }
+    
+    timestamp(&sec, &usec);
+    
+    /* pcap record header */
+    p = put32(p, sec);
+    p = put32(p, usec);
+    p = put32(p, USBMON_HEADER_SIZE + length);
+    p = put32(p, USBMON_HEADER_SIZE + length);
+    
+    /* usbmon header */
+    p = put32(p, id++);
+    p = put32(p, 0);
+    *p++ = type;
+    *p++ = transferType;
+    *p++ = endpoint;
+    *p++ = address;
+    p = put16(p, USBMON_BUS);
+    *p++ = USBMON_NO_SETUP;
+    *p++ = (length > 0) ? USBMON_DATA_PRESENT : USBMON_NO_DATA;
+    p = put32(p, sec);
+    p = put32(p, 0);
+    p = put32(p, usec);
+    p = put32(p, (type == PCAP_SUBMIT) ? USBMON_EINPROGRESS : 0);
+    p = put32(p, length);
+    p = put32(p, length);
+    for (i=0; i<8; i++)
+    {
+        *p++ = 0;
+    }
+    
+    put(header, data, length);
+}
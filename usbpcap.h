@@ -0,0 +1,50 @@
+/* usbpcap.h */
+/* Capture of USB transactions in pcap format (Linux usbmon link type) */
+
+#ifndef USBPCAP_H
+#define USBPCAP_H
+
+#include "mbed.h"
+
+/* Bytes buffered between calls to flush(); packets that do not fit are dropped */
+#ifndef PCAP_BUFFER_SIZE
+#define PCAP_BUFFER_SIZE (4096)
+#endif
+
+/* usbmon event types */
+#define PCAP_SUBMIT   ('S')
+#define PCAP_COMPLETE ('C')
+
+/* usbmon transfer types */
+#define PCAP_ISOCHRONOUS (0)
+#define PCAP_INTERRUPT   (1)
+#define PCAP_CONTROL     (2)
+#define PCAP_BULK        (3)
+
+class usbpcap
+{
+public:
+    usbpcap();
+    bool open(const char *path);
+    void close(void);
+    void flush(void);
+    void setup(unsigned char address, unsigned char *packet);
+    void packet(unsigned char type, unsigned char transferType, unsigned char endpoint, 
+                unsigned char address, unsigned char *data, unsigned long length);
+    unsigned long dropped(void);
+private:
+    void put(unsigned char *header, unsigned char *data, unsigned long length);
+    void timestamp(unsigned long *seconds, unsigned long *microseconds);
+    FILE *file;
+    Timer timer;
+    unsigned long lastTime;
+    unsigned long seconds;
+    unsigned long microseconds;
+    unsigned long id;
+    unsigned long droppedPackets;
+    unsigned char buffer[PCAP_BUFFER_SIZE];
+    unsigned long head;
+    unsigned long tail;
+};
+
+#endif
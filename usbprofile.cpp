@@ -0,0 +1,67 @@
+/* usbprofile.cpp */
+/* Per-stage cycle profile of the USB stack */
+
+#include "mbed.h"
+#include "usbprofile.h"
+
+#ifdef USB_PROFILE
+
+CYCLE_STATISTICS profileStages[PROFILE_STAGES];
+
+static const char *stageNames[PROFILE_STAGES] = {
+    "isr",
+    "sie_command",
+    "endpoint_write",
+    "control_setup",
+    "wait_configured",
+    "wait_complete"
+};
+
+void profileReset(void)
+{
+    /* Clear every stage; the cycle counter is left running */
+    unsigned char i;
+    
+    for (i=0; i<PROFILE_STAGES; i++)
+    {
+        cycleStatisticsReset(&profileStages[i]);
+    }
+}
+
+void profileDump(FILE *output)
+{
+    /* Print count and min/avg/max cycles of each stage */
+    unsigned char i;
+    unsigned long average;
+    unsigned long min;
+    
+    fprintf(output, "stage            count        min        avg        max\n");
+    
+    for (i=0; i<PROFILE_STAGES; i++)
+    {
+        average = 0;
+        min = 0;
+        
+        if (profileStages[i].count > 0)
+        {
+            average = profileStages[i].total / profileStages[i].count;
+            min = profileStages[i].min;
+        }
+        
+        fprintf(output, "%-15s %6lu %10lu %10lu %10lu\n", stageNames[i],
+            profileStages[i].count, min, average, profileStages[i].max);
+    }
+}
+
+#else
+
+void profileReset(void)
+{
+}
+
+void profileDump(FILE *output)
+{
+    fprintf(output, "USB profiling not enabled (build with USB_PROFILE)\n");
+}
+
+#endif
@@ -0,0 +1,37 @@
+/* usbprofile.h */
+/* Per-stage cycle profile of the USB stack */
+
+#ifndef USBPROFILE_H
+#define USBPROFILE_H
+
+#include "mbed.h"
+#include "usbcycles.h"
+
+/* The benchmark reads the interrupt dispatch stage */
+#if defined(USB_BENCHMARK) && !defined(USB_PROFILE)
+#define USB_PROFILE
+#endif
+
+/* Profiled stages */
+#define PROFILE_ISR             (0) /* Interrupt dispatch */
+#define PROFILE_SIE_COMMAND     (1) /* SIE command phase */
+#define PROFILE_ENDPOINT_WRITE  (2) /* endpointWrite() */
+#define PROFILE_CONTROL_SETUP   (3) /* Setup packet handling */
+#define PROFILE_WAIT_CONFIGURED (4) /* sendInputReport() waiting to be configured */
+#define PROFILE_WAIT_COMPLETE   (5) /* sendInputReport() waiting for the host */
+#define PROFILE_STAGES          (6)
+
+/* Probes compile to nothing unless USB_PROFILE is defined */
+#ifdef USB_PROFILE
+extern CYCLE_STATISTICS profileStages[PROFILE_STAGES];
+#define PROFILE_BEGIN(stage) unsigned long profileStart##stage = cycleCounterRead()
+#define PROFILE_END(stage)   cycleStatisticsAdd(&profileStages[stage], cycleCounterRead() - profileStart##stage)
+#else
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+#endif
+
+void profileReset(void);
+void profileDump(FILE *output);
+
+#endif
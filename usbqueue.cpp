@@ -0,0 +1,104 @@
+/* usbqueue.cpp */
+/* Lock-free multiple producer, single consumer input event queue */
+
+/* Each slot carries a sequence number. A slot is free for the producer  */
+/* claiming position n when its sequence is n, and holds an event for   */
+/* the consumer at position n when its sequence is n+1. Producers claim  */
+/* positions with LDREX/STREX so no producer ever blocks another.        */
+
+#include "mbed.h"
+#include "usbqueue.h"
+
+static bool compareAndSwap(volatile uint32_t *address, uint32_t expected, uint32_t value)
+{
+    /* Atomically replace *address with value if it equals expected */
+    do {
+        if (__LDREXW(address) != expected)
+        {
+            __CLREX();
+            return false;
+        }
+    } while (__STREXW(value, address) != 0);
+    
+    return true;
+}
+
+usbqueue::usbqueue()
+{
+    uint32_t i;
+    
+    for (i=0; i<INPUT_QUEUE_SIZE; i++)
+    {
+        slots[i].sequence = i;
+    }
+    
+    head = 0;
+    tail = 0;
+}
+
+bool usbqueue::push(const INPUT_EVENT *event)
+{
+    /* Add an event; safe to call from any number of threads or interrupts. */
+    /* Returns false if the queue is full. */
+    INPUT_SLOT *slot;
+    uint32_t position;
+    long difference;
+    
+    position = tail;
+    
+    for (;;)
+    {
+        slot = &slots[position % INPUT_QUEUE_SIZE];
+        difference = (long)(slot->sequence - position);
+        
+        if (difference == 0)
+        {
+            /* Slot is free; try to claim it */
+            if (compareAndSwap(&tail, position, position + 1))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            /* Slot still holds an unread event; queue is full */
+            return false;
+        }
+        
+        /* Another producer claimed this position first */
+        position = tail;
+    }
+    
+    slot->event = *event;
+    
+    /* Publish the event to the consumer */
+    __DMB();
+    slot->sequence = position + 1;
+    return true;
+}
+
+bool usbqueue::peek(INPUT_EVENT *event)
+{
+    /* Copy the oldest event without removing it; consumer only. */
+    /* Returns false if the queue is empty. */
+    INPUT_SLOT *slot = &slots[head % INPUT_QUEUE_SIZE];
+    
+    if (slot->sequence != head + 1)
+    {
+        return false;
+    }
+    
+    __DMB();
+    *event = slot->event;
+    return true;
+}
+
+void usbqueue::pop(void)
+{
+    /* Remove the oldest event, returning its slot to the producers; consumer only */
+    INPUT_SLOT *slot = &slots[head % INPUT_QUEUE_SIZE];
+    
+    __DMB();
+    slot->sequence = head + INPUT_QUEUE_SIZE;
+    head++;
+}
@@ -0,0 +1,70 @@
+/* usbqueue.h */
+/* Lock-free multiple producer, single consumer input event queue */
+
+#ifndef USBQUEUE_H
+#define USBQUEUE_H
+
+#include "mbed.h"
+#include "asciihid.h"
+
+/* Number of events held; must be a power of two */
+#ifndef INPUT_QUEUE_SIZE
+#define INPUT_QUEUE_SIZE (32)
+#endif
+
+/* Event types */
+#define INPUT_MOUSE    (1)
+#define INPUT_KEYBOARD (2)
+#define INPUT_REPORTS  (3)    /* Prebuilt key press reports, see keyreports.h */
+#define INPUT_CONSUMER (4)
+#define INPUT_SYSTEM   (5)
+#define INPUT_TOUCH    (6)
+
+/* One finger of a touch screen frame */
+typedef struct {
+    unsigned char  id;     /* Identifies the finger from frame to frame; 0 to 127 */
+    bool           tip;    /* Touching; report each lifted finger once with tip false */
+    unsigned short x;      /* 0 to TOUCH_MAX across the screen */
+    unsigned short y;      /* 0 to TOUCH_MAX down the screen */
+} TOUCH_CONTACT;
+
+/* Called once the report carrying an event has been collected by the host. */
+/* Runs in the context of the USB interrupt (or poll() in polled mode). */
+typedef void (*INPUT_CALLBACK)(void *context);
+
+typedef struct {
+    INPUT_CALLBACK   callback; /* Optional */
+    void             *context;
+    const KEY_REPORT *reports; /* INPUT_REPORTS */
+    const TOUCH_CONTACT *contacts; /* INPUT_TOUCH */
+    unsigned char    type;
+    unsigned char    buttons;  /* INPUT_MOUSE */
+    unsigned short   code;     /* INPUT_KEYBOARD: Unicode code point */
+                               /* INPUT_REPORTS: number of reports */
+                               /* INPUT_CONSUMER, INPUT_SYSTEM: usage */
+                               /* INPUT_TOUCH: number of contacts */
+    signed char      x;        /* INPUT_MOUSE */
+    signed char      y;        /* INPUT_MOUSE */
+    signed char      wheel;    /* INPUT_MOUSE */
+    unsigned long    time;     /* When posted, us_ticker_read(); for the reset policy */
+} INPUT_EVENT;
+
+typedef struct {
+    volatile uint32_t sequence;
+    INPUT_EVENT       event;
+} INPUT_SLOT;
+
+class usbqueue
+{
+public:
+    usbqueue();
+    bool push(const INPUT_EVENT *event);
+    bool peek(INPUT_EVENT *event);
+    void pop(void);
+private:
+    INPUT_SLOT slots[INPUT_QUEUE_SIZE];
+    volatile uint32_t tail; /* Next slot to be claimed by a producer */
+    uint32_t head;          /* Next slot to be read by the consumer */
+};
+
+#endif
@@ -0,0 +1,124 @@
+/* usbtrace.cpp */
+/* USB device controller event trace */
+
+#include "mbed.h"
+#include "usbtrace.h"
+#include "usbcycles.h"
+
+/* Saved trace file header */
+#define TRACE_MAGIC   (0x54425355) /* "USBT" */
+#define TRACE_VERSION (1)
+
+usbtrace::usbtrace()
+{
+    cycleCounterEnable();
+    clear();
+}
+
+void usbtrace::clear(void)
+{
+    /* Discard all records */
+    head = 0;
+    tail = 0;
+    droppedRecords = 0;
+}
+
+unsigned long usbtrace::dropped(void)
+{
+    /* Records overwritten before they were read */
+    return droppedRecords;
+}
+
+void usbtrace::record(unsigned char type, unsigned char endpoint, unsigned short data)
+{
+    /* Add a record, overwriting the oldest if the ring is full */
+    /* Records are made from both interrupt and thread context, and from */
+    /* code already running with interrupts disabled */
+    TRACE_RECORD *r;
+    uint32_t primask = __get_PRIMASK();
+    
+    __disable_irq();
+    
+    if ((head - tail) == TRACE_RECORDS)
+    {
+        tail++;
+        droppedRecords++;
+    }
+    
+    r = &records[head % TRACE_RECORDS];
+    r->time = cycleCounterRead();
+    r->type = type;
+    r->endpoint = endpoint;
+    r->data = data;
+    head++;
+    
+    __set_PRIMASK(primask);
+}
+
+unsigned long usbtrace::read(TRACE_RECORD *buffer, unsigned long size)
+{
+    /* Remove up to size of the oldest records. Returns the number read */
+    unsigned long count = 0;
+    uint32_t primask = __get_PRIMASK();
+    
+    __disable_irq();
+    
+    while ((count < size) && (tail != head))
+    {
+        *buffer++ = records[tail % TRACE_RECORDS];
+        tail++;
+        count++;
+    }
+    
+    __set_PRIMASK(primask);
+    
+    return count;
+}
+
+static void putWord(FILE *output, unsigned long value)
+{
+    /* Write a 32-bit value, least significant byte first */
+    fputc(value, output);
+    fputc(value >> 8, output);
+    fputc(value >> 16, output);
+    fputc(value >> 24, output);
+}
+
+unsigned long usbtrace::save(FILE *output)
+{
+    /* Drain the trace to a file in binary form. Returns the number of records */
+    /* Header: magic, version, record count, dropped count (32-bit each) */
+    /* Record: time (32-bit), type, endpoint, data (16-bit); little endian */
+    TRACE_RECORD r;
+    unsigned long count;
+    unsigned long i;
+    uint32_t primask = __get_PRIMASK();
+    
+    __disable_irq();
+    count = head - tail;
+    __set_PRIMASK(primask);
+    
+    putWord(output, TRACE_MAGIC);
+    putWord(output, TRACE_VERSION);
+    putWord(output, count);
+    putWord(output, droppedRecords);
+    
+    for (i=0; i<count; i++)
+    {
+        if (read(&r, 1) != 1)
+        {
+            /* Cannot happen while this is the only reader; pad the file */
+            r.time = 0;
+            r.type = 0;
+            r.endpoint = 0;
+            r.data = 0;
+        }
+        putWord(output, r.time);
+        fputc(r.type, output);
+        fputc(r.endpoint, output);
+        fputc(r.data, output);
+        fputc(r.data >> 8, output);
+    }
+    
+    return count;
+}
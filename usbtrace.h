@@ -0,0 +1,47 @@
+/* usbtrace.h */
+/* USB device controller event trace */
+
+#ifndef USBTRACE_H
+#define USBTRACE_H
+
+#include "mbed.h"
+
+/* Number of records held; must be a power of two */
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS (512)
+#endif
+
+/* Record types */
+#define TRACE_ISR         (1) /* endpoint: USBEpIntSt, data: USBDevIntSt */
+#define TRACE_SIE_COMMAND (2) /* data: command code */
+#define TRACE_SIE_WRITE   (3) /* data: byte written */
+#define TRACE_SIE_READ    (4) /* data: byte read */
+#define TRACE_EP_READ     (5) /* endpoint, data: packet size */
+#define TRACE_EP_WRITE    (6) /* endpoint, data: packet size */
+#define TRACE_EP_EVENT    (7) /* endpoint, data: select endpoint status */
+#define TRACE_RESET       (8) /* data: SIE device status */
+
+typedef struct {
+    unsigned long  time;     /* DWT cycle count */
+    unsigned char  type;
+    unsigned char  endpoint;
+    unsigned short data;
+} TRACE_RECORD;
+
+class usbtrace
+{
+public:
+    usbtrace();
+    void record(unsigned char type, unsigned char endpoint, unsigned short data);
+    unsigned long read(TRACE_RECORD *buffer, unsigned long size);
+    unsigned long save(FILE *output);
+    void clear(void);
+    unsigned long dropped(void);
+private:
+    TRACE_RECORD records[TRACE_RECORDS];
+    unsigned long head;
+    unsigned long tail;
+    unsigned long droppedRecords;
+};
+
+#endif